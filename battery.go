@@ -0,0 +1,209 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+extern void goBatterystatusupdatefunc(unsigned short deviceID, Jabra_BatteryStatus* batteryStatus);
+*/
+import "C"
+import (
+	"log"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+type BatterySample struct {
+	Time     int64 // unix seconds
+	Level    uint8 // percent
+	Charging bool
+}
+
+func (s BatterySample) sampleTime() int64 { return s.Time }
+
+// batteryRollup averages the levels of a period, it is charging if any sample is.
+type batteryRollup struct {
+	sum      int
+	charging bool
+}
+
+func (r *batteryRollup) add(s BatterySample) {
+	r.sum += int(s.Level)
+	r.charging = r.charging || s.Charging
+}
+
+func (r *batteryRollup) result(period int64, count int) BatterySample {
+	s := BatterySample{Time: period, Level: uint8(r.sum / count), Charging: r.charging}
+	*r = batteryRollup{}
+	return s
+}
+
+// BatterySeries keeps the battery history of one component of a device:
+// the raw samples, and 1 minute and 1 hour averages.
+type BatterySeries struct {
+	LowBattery bool
+	raw        sampleRing[BatterySample]
+	minute     sampleTier[BatterySample]
+	hour       sampleTier[BatterySample]
+}
+
+func newBatterySeries() *BatterySeries {
+	return &BatterySeries{
+		raw:    newSampleRing[BatterySample](256),
+		minute: newSampleTier[BatterySample](60, 24*60, &batteryRollup{}),
+		hour:   newSampleTier[BatterySample](3600, 30*24, &batteryRollup{}),
+	}
+}
+
+func (b *BatterySeries) add(s BatterySample) {
+	b.raw.push(s)
+	b.minute.add(s)
+	b.hour.add(s)
+}
+
+type batteryKey struct {
+	SerialNumber string
+	Component    int
+}
+
+var batterySeries = make(map[batteryKey]*BatterySeries, 0)
+var batteryLock = sync.Mutex{}
+
+func registerBatteryTelemetry() {
+	C.Jabra_RegisterBatteryStatusUpdateCallbackV2((*[0]byte)(C.goBatterystatusupdatefunc))
+	registerStats("battery", batteryStats)
+}
+
+//export goBatterystatusupdatefunc
+func goBatterystatusupdatefunc(deviceid uint16, status *C.Jabra_BatteryStatus) {
+	if status == nil {
+		return
+	}
+	defer C.Jabra_FreeBatteryStatus(status)
+
+	deviceListLock.Lock()
+	device, ok := deviceList[deviceid]
+	deviceListLock.Unlock()
+	if !ok {
+		return
+	}
+
+	now := time.Now().Unix()
+	charging := (bool)(status.charging)
+	batteryLock.Lock()
+	defer batteryLock.Unlock()
+	series := recordBattery(batteryKey{device.SerialNumber, int(status.component)},
+		BatterySample{Time: now, Level: uint8(status.levelInPercent), Charging: charging})
+	low := (bool)(status.batteryLow)
+	if low && !series.LowBattery {
+		log.Printf("battery low on %s: %d%%", device.DeviceName, uint8(status.levelInPercent))
+	}
+	series.LowBattery = low
+	telemetry.Append(device.SerialNumber, TelemetryBattery, int64(status.levelInPercent))
+
+	units := unsafe.Slice(status.extraUnits, int(status.extraUnitsCount))
+	for _, unit := range units {
+		recordBattery(batteryKey{device.SerialNumber, int(unit.component)},
+			BatterySample{Time: now, Level: uint8(unit.levelInPercent), Charging: charging})
+	}
+}
+
+// recordBattery appends a sample to a series, batteryLock must be held.
+func recordBattery(key batteryKey, sample BatterySample) *BatterySeries {
+	series, ok := batterySeries[key]
+	if !ok {
+		series = newBatterySeries()
+		batterySeries[key] = series
+	}
+	series.add(sample)
+	return series
+}
+
+// BatteryLevel returns the last reported level and charging state of a device component.
+func BatteryLevel(serialNumber string, component int) (BatterySample, bool) {
+	batteryLock.Lock()
+	defer batteryLock.Unlock()
+	series, ok := batterySeries[batteryKey{serialNumber, component}]
+	if !ok {
+		return BatterySample{}, false
+	}
+	return series.raw.last()
+}
+
+// BatteryHistory returns the samples of a tier ("raw", "minute" or "hour") since t.
+func BatteryHistory(serialNumber string, component int, tier string, t time.Time) []BatterySample {
+	batteryLock.Lock()
+	defer batteryLock.Unlock()
+	series, ok := batterySeries[batteryKey{serialNumber, component}]
+	if !ok {
+		return nil
+	}
+	switch tier {
+	case "minute":
+		return series.minute.ring.since(t.Unix())
+	case "hour":
+		return series.hour.ring.since(t.Unix())
+	default:
+		return series.raw.since(t.Unix())
+	}
+}
+
+// BatteryDischargeRate estimates the discharge rate in percent per hour from
+// the last hour of 1 minute averages, with a least squares fit over the
+// samples taken since the device last stopped charging.
+func BatteryDischargeRate(serialNumber string, component int) (float64, bool) {
+	samples := BatteryHistory(serialNumber, component, "minute", time.Now().Add(-time.Hour))
+	for i := len(samples) - 1; i >= 0; i-- {
+		if samples[i].Charging {
+			samples = samples[i+1:]
+			break
+		}
+	}
+	if len(samples) < 2 {
+		return 0, false
+	}
+	var sumX, sumY, sumXY, sumXX float64
+	for _, s := range samples {
+		x := float64(s.Time-samples[0].Time) / 3600
+		y := float64(s.Level)
+		sumX += x
+		sumY += y
+		sumXY += x * y
+		sumXX += x * x
+	}
+	n := float64(len(samples))
+	denominator := n*sumXX - sumX*sumX
+	if denominator == 0 {
+		return 0, false
+	}
+	return -(n*sumXY - sumX*sumY) / denominator, true
+}
+
+type BatteryStats struct {
+	SerialNumber  string
+	Component     int
+	Level         uint8
+	Charging      bool
+	LowBattery    bool
+	DischargeRate float64 `json:",omitempty"` // percent per hour
+}
+
+func batteryStats() interface{} {
+	batteryLock.Lock()
+	stats := make([]BatteryStats, 0, len(batterySeries))
+	for key, series := range batterySeries {
+		last, _ := series.raw.last()
+		stats = append(stats, BatteryStats{
+			SerialNumber: key.SerialNumber,
+			Component:    key.Component,
+			Level:        last.Level,
+			Charging:     last.Charging,
+			LowBattery:   series.LowBattery,
+		})
+	}
+	batteryLock.Unlock()
+	for i := range stats {
+		stats[i].DischargeRate, _ = BatteryDischargeRate(stats[i].SerialNumber, stats[i].Component)
+	}
+	return stats
+}
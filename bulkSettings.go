@@ -0,0 +1,142 @@
+package main
+
+import (
+	"encoding/json"
+	"net/http"
+	"strconv"
+	"sync"
+)
+
+// BulkSettingsResult is the outcome of a bulk apply on one device.
+type BulkSettingsResult struct {
+	DeviceName string
+	SettingsResult
+	Errors []string `json:",omitempty"`
+}
+
+// splitRestartSettings validates a profile and separates the settings that
+// reboot the device from the others.
+func splitRestartSettings(device *DeviceInfo, desired map[string]string) (map[string]string, map[string]string, error) {
+	ds, err := loadDeviceSettings(device)
+	if err != nil {
+		return nil, nil, err
+	}
+	settingsLock.Lock()
+	err = ds.validateProfile(desired)
+	settingsLock.Unlock()
+	if err != nil {
+		return nil, nil, err
+	}
+	normal := make(map[string]string, len(desired))
+	restart := make(map[string]string, 0)
+	for guid, value := range desired {
+		if setting := ds.manifest.find(guid); setting != nil && setting.Restart {
+			restart[guid] = value
+		} else {
+			normal[guid] = value
+		}
+	}
+	return normal, restart, nil
+}
+
+// BulkApplySettings applies a profile to several devices, at most parallel
+// devices at a time. Settings that do not need a restart are applied to
+// every device first, then the restart settings of each device are sent in
+// a single batch, so a device reboots at most once and never delays the
+// others.
+func BulkApplySettings(devices []*DeviceInfo, desired map[string]string, parallel int) map[string]*BulkSettingsResult {
+	if parallel < 1 {
+		parallel = 1
+	}
+	results := make(map[string]*BulkSettingsResult, len(devices))
+	restart := make(map[uint16]map[string]string, len(devices))
+	for _, device := range devices {
+		results[device.SerialNumber] = &BulkSettingsResult{DeviceName: device.DeviceName}
+	}
+	lock := sync.Mutex{}
+	record := func(device *DeviceInfo, result SettingsResult, err error) {
+		lock.Lock()
+		defer lock.Unlock()
+		r := results[device.SerialNumber]
+		r.Written = append(r.Written, result.Written...)
+		r.Failed = append(r.Failed, result.Failed...)
+		r.Rebooted = r.Rebooted || result.Rebooted
+		r.Skipped = append(r.Skipped, result.Skipped...)
+		r.Disabled = append(r.Disabled, result.Disabled...)
+		if err != nil {
+			r.Errors = append(r.Errors, err.Error())
+		}
+	}
+
+	run := func(phase func(device *DeviceInfo)) {
+		semaphore := make(chan struct{}, parallel)
+		wg := sync.WaitGroup{}
+		for _, device := range devices {
+			wg.Add(1)
+			semaphore <- struct{}{}
+			go func(device *DeviceInfo) {
+				defer wg.Done()
+				defer func() { <-semaphore }()
+				phase(device)
+			}(device)
+		}
+		wg.Wait()
+	}
+
+	run(func(device *DeviceInfo) {
+		normal, restartSettings, err := splitRestartSettings(device, desired)
+		if err != nil {
+			record(device, SettingsResult{}, err)
+			return
+		}
+		lock.Lock()
+		restart[device.DeviceID] = restartSettings
+		lock.Unlock()
+		result, err := ApplySettings(device, normal)
+		record(device, result, err)
+	})
+	run(func(device *DeviceInfo) {
+		lock.Lock()
+		restartSettings := restart[device.DeviceID]
+		lock.Unlock()
+		if len(restartSettings) == 0 {
+			return
+		}
+		result, err := ApplyRestartSettings(device, restartSettings)
+		record(device, result, err)
+	})
+	return results
+}
+
+// serveBulkSettings applies the JSON profile posted to /settings/apply to
+// every attached device except dongles, ?parallel=N sets the concurrency.
+func serveBulkSettings(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodPost {
+		http.Error(w, "POST a JSON object of setting values by GUID", http.StatusMethodNotAllowed)
+		return
+	}
+	desired := make(map[string]string)
+	if err := json.NewDecoder(r.Body).Decode(&desired); err != nil {
+		http.Error(w, err.Error(), http.StatusBadRequest)
+		return
+	}
+	parallel, err := strconv.Atoi(r.URL.Query().Get("parallel"))
+	if err != nil {
+		parallel = 4
+	}
+
+	deviceListLock.Lock()
+	devices := make([]*DeviceInfo, 0, len(deviceList))
+	for _, device := range deviceList {
+		if !device.IsDongle {
+			devices = append(devices, device)
+		}
+	}
+	deviceListLock.Unlock()
+
+	writeJSON(w, BulkApplySettings(devices, desired, parallel))
+}
+
+func init() {
+	registerControl("/settings/apply", serveBulkSettings)
+}
@@ -0,0 +1,55 @@
+package main
+
+import (
+	"sync"
+	"time"
+)
+
+// busySource identifies a signal that can turn the busy light on.
+// The light is on as long as at least one source reports busy.
+type busySource uint8
+
+const (
+	busySourceAudio busySource = 1 << iota
+	busySourceCalendar
+	busySourceCamera
+)
+
+var busySources busySource
+var busySince = time.Now() // last change between busy and idle
+var busyLock = sync.Mutex{}
+
+func setBusy(source busySource, value bool) {
+	busyLock.Lock()
+	defer busyLock.Unlock()
+	was := busySources != 0
+	if value {
+		busySources |= source
+	} else {
+		busySources &^= source
+	}
+	if was != (busySources != 0) {
+		busySince = time.Now()
+	}
+	applyBusy()
+}
+
+// applyBusy pushes the combined state to the main device, busyLock must be held.
+func applyBusy() {
+	if mainDevice != nil {
+		mainDevice.SetBusylightStatus(busySources != 0)
+	}
+}
+
+// busyState returns whether the user is busy and since when the state last changed.
+func busyState() (bool, time.Time) {
+	busyLock.Lock()
+	defer busyLock.Unlock()
+	return busySources != 0, busySince
+}
+
+func refreshBusy() {
+	busyLock.Lock()
+	defer busyLock.Unlock()
+	applyBusy()
+}
@@ -0,0 +1,381 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"hash/fnv"
+	"log"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+type interval struct {
+	Start time.Time
+	End   time.Time
+}
+
+// calendarEvent is a parsed VEVENT, recurring when rule is set.
+type calendarEvent struct {
+	uid          string
+	recurrenceID time.Time // set on an instance that overrides one of a recurring event
+	start, end   time.Time // of the first occurrence
+	rule         *recurrenceRule
+	exdates      recurrenceExceptions
+}
+
+// calendarHorizon is how far ahead recurring events are expanded, the
+// calendar is expanded again once half of it has passed.
+const calendarHorizon = 60 * 24 * time.Hour
+
+// Calendar keeps the busy windows of a local .ics file as a sorted list of
+// disjoint intervals, so lookups are a binary search.
+type Calendar struct {
+	Path    string
+	lock    sync.Mutex
+	windows []interval
+	// end of the expansion of recurring events
+	expanded time.Time
+	// parsed VEVENT blocks keyed by a hash of their raw text, reused on
+	// reload, nil for blocks that never make the user busy
+	blocks map[uint64]*calendarEvent
+	reload chan struct{}
+}
+
+func NewCalendar(path string) *Calendar {
+	return &Calendar{
+		Path:   path,
+		blocks: make(map[uint64]*calendarEvent),
+		reload: make(chan struct{}, 1),
+	}
+}
+
+func (c *Calendar) Load() error {
+	start := time.Now()
+	data, err := os.ReadFile(c.Path)
+	if err != nil {
+		return err
+	}
+
+	blocks := make(map[uint64]*calendarEvent, len(c.blocks))
+	reused := 0
+	var events []*calendarEvent
+	for _, raw := range splitEvents(data) {
+		h := fnv.New64a()
+		h.Write(raw)
+		key := h.Sum64()
+		event, ok := c.blocks[key]
+		if ok {
+			reused++
+		} else {
+			event = parseEvent(raw)
+		}
+		blocks[key] = event
+		if event != nil {
+			events = append(events, event)
+		}
+	}
+	from, to := start, start.Add(calendarHorizon)
+	windows := mergeIntervals(expandEvents(events, from, to))
+
+	c.lock.Lock()
+	c.blocks = blocks
+	c.windows = windows
+	c.expanded = to
+	c.lock.Unlock()
+
+	log.Printf("calendar: loaded %d events (%d reused, %d busy windows) from %s in %s",
+		len(blocks), reused, len(windows), c.Path, time.Since(start))
+	return nil
+}
+
+// expandEvents returns the busy intervals of the events, the occurrences of
+// recurring events only between from and to. An instance that overrides an
+// occurrence (same UID and RECURRENCE-ID) replaces it, even when the
+// instance itself does not make the user busy.
+func expandEvents(events []*calendarEvent, from, to time.Time) []interval {
+	overridden := make(map[string]map[int64]bool)
+	for _, event := range events {
+		if event.recurrenceID.IsZero() {
+			continue
+		}
+		if overridden[event.uid] == nil {
+			overridden[event.uid] = make(map[int64]bool)
+		}
+		overridden[event.uid][event.recurrenceID.Unix()] = true
+	}
+	all := make([]interval, 0, len(events))
+	for _, event := range events {
+		if event.end.IsZero() {
+			// a cancelled or transparent override, kept only to hide its occurrence
+			continue
+		}
+		if event.rule == nil {
+			all = append(all, interval{Start: event.start, End: event.end})
+			continue
+		}
+		skip := overridden[event.uid]
+		event.rule.expand(event.start, event.end.Sub(event.start), from, to, func(start time.Time) {
+			if !skip[start.Unix()] && !event.exdates.match(start) {
+				all = append(all, interval{Start: start, End: start.Add(event.end.Sub(event.start))})
+			}
+		})
+	}
+	return all
+}
+
+// State returns whether t falls in a busy window and the time of the next
+// busy/free transition, zero if there is none.
+func (c *Calendar) State(t time.Time) (bool, time.Time) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	i := sort.Search(len(c.windows), func(i int) bool { return c.windows[i].End.After(t) })
+	if i == len(c.windows) {
+		return false, time.Time{}
+	}
+	if !c.windows[i].Start.After(t) {
+		return true, c.windows[i].End
+	}
+	return false, c.windows[i].Start
+}
+
+// calendarMaxWait bounds the sleep until the next transition.
+const calendarMaxWait = time.Minute
+
+// Run drives the calendar busy source, waking up on transitions, file changes
+// and at least every calendarMaxWait, recurring events are expanded again
+// once half of calendarHorizon has passed.
+func (c *Calendar) Run() {
+	if err := c.Load(); err != nil {
+		log.Println("calendar:", err)
+	}
+	go c.watch()
+
+	timer := time.NewTimer(0)
+	for {
+		select {
+		case <-timer.C:
+			c.lock.Lock()
+			stale := time.Until(c.expanded) < calendarHorizon/2
+			c.lock.Unlock()
+			if stale {
+				if err := c.Load(); err != nil {
+					log.Println("calendar:", err)
+				}
+			}
+		case <-c.reload:
+			if err := c.Load(); err != nil {
+				log.Println("calendar:", err)
+			}
+		}
+		busy, next := c.State(time.Now())
+		setBusy(busySourceCalendar, busy)
+		if !timer.Stop() {
+			select {
+			case <-timer.C:
+			default:
+			}
+		}
+		// timers do not advance while the machine is suspended, so the
+		// wall clock is checked again at least every calendarMaxWait
+		wait := calendarMaxWait
+		if !next.IsZero() && time.Until(next) < wait {
+			wait = time.Until(next)
+		}
+		timer.Reset(wait)
+	}
+}
+
+// watch uses inotify on the parent directory, sync tools usually replace the file atomically.
+func (c *Calendar) watch() {
+	fd, err := syscall.InotifyInit1(syscall.IN_CLOEXEC)
+	if err != nil {
+		log.Println("calendar: inotify:", err)
+		return
+	}
+	defer syscall.Close(fd)
+	dir, name := filepath.Split(filepath.Clean(c.Path))
+	if dir == "" {
+		dir = "."
+	}
+	_, err = syscall.InotifyAddWatch(fd, dir, syscall.IN_CLOSE_WRITE|syscall.IN_MOVED_TO|syscall.IN_CREATE)
+	if err != nil {
+		log.Println("calendar: inotify:", err)
+		return
+	}
+
+	buf := make([]byte, 4096)
+	for {
+		n, err := syscall.Read(fd, buf)
+		if err != nil {
+			log.Println("calendar: inotify:", err)
+			return
+		}
+		changed := false
+		for off := 0; off+syscall.SizeofInotifyEvent <= n; {
+			event := (*syscall.InotifyEvent)(unsafe.Pointer(&buf[off]))
+			nameBytes := buf[off+syscall.SizeofInotifyEvent : off+syscall.SizeofInotifyEvent+int(event.Len)]
+			if string(bytes.TrimRight(nameBytes, "\x00")) == name {
+				changed = true
+			}
+			off += syscall.SizeofInotifyEvent + int(event.Len)
+		}
+		if changed {
+			select {
+			case c.reload <- struct{}{}:
+			default:
+			}
+		}
+	}
+}
+
+// splitEvents returns the raw text of each VEVENT block.
+func splitEvents(data []byte) [][]byte {
+	var events [][]byte
+	for {
+		start := bytes.Index(data, []byte("BEGIN:VEVENT"))
+		if start < 0 {
+			return events
+		}
+		end := bytes.Index(data[start:], []byte("END:VEVENT"))
+		if end < 0 {
+			return events
+		}
+		events = append(events, data[start:start+end])
+		data = data[start+end:]
+	}
+}
+
+// parseEvent returns the event of a VEVENT block, nil if it never makes the
+// user busy. Transparent and all-day events do not make the user busy, and
+// neither do cancelled ones, which are still returned without an end when
+// they override an occurrence of a recurring event.
+func parseEvent(raw []byte) *calendarEvent {
+	var event calendarEvent
+	var duration time.Duration
+	var rrule string
+	cancelled := false
+	scanner := bufio.NewScanner(bytes.NewReader(raw))
+	var lines []string
+	for scanner.Scan() {
+		line := strings.TrimRight(scanner.Text(), "\r")
+		if len(line) > 0 && (line[0] == ' ' || line[0] == '\t') && len(lines) > 0 {
+			lines[len(lines)-1] += line[1:]
+			continue
+		}
+		lines = append(lines, line)
+	}
+	for _, line := range lines {
+		sep := strings.IndexByte(line, ':')
+		if sep < 0 {
+			continue
+		}
+		params := strings.Split(line[:sep], ";")
+		value := line[sep+1:]
+		switch params[0] {
+		case "UID":
+			event.uid = value
+		case "RECURRENCE-ID":
+			event.recurrenceID = parseICSTime(params[1:], value)
+		case "DTSTART":
+			event.start = parseICSTime(params[1:], value)
+		case "DTEND":
+			event.end = parseICSTime(params[1:], value)
+		case "DURATION":
+			duration = parseICSDuration(value)
+		case "RRULE":
+			rrule = value
+		case "EXDATE":
+			event.exdates.add(params[1:], value)
+		case "STATUS":
+			cancelled = cancelled || value == "CANCELLED"
+		case "TRANSP":
+			cancelled = cancelled || value == "TRANSPARENT"
+		}
+	}
+	if event.start.IsZero() {
+		return nil
+	}
+	if event.end.IsZero() {
+		event.end = event.start.Add(duration)
+	}
+	if cancelled || !event.end.After(event.start) {
+		if event.recurrenceID.IsZero() {
+			return nil
+		}
+		event.end = time.Time{}
+		return &event
+	}
+	if rrule != "" && event.recurrenceID.IsZero() {
+		event.rule = parseRecurrenceRule(rrule, event.start.Location())
+	}
+	return &event
+}
+
+func parseICSTime(params []string, value string) time.Time {
+	loc := time.Local
+	for _, param := range params {
+		if param == "VALUE=DATE" {
+			return time.Time{}
+		}
+		if strings.HasPrefix(param, "TZID=") {
+			if l, err := time.LoadLocation(strings.Trim(param[5:], "\"")); err == nil {
+				loc = l
+			}
+		}
+	}
+	if strings.HasSuffix(value, "Z") {
+		t, _ := time.Parse("20060102T150405Z", value)
+		return t
+	}
+	t, _ := time.ParseInLocation("20060102T150405", value, loc)
+	return t
+}
+
+// parseICSDuration parses RFC 5545 durations such as PT1H30M or P1D.
+func parseICSDuration(value string) time.Duration {
+	var d time.Duration
+	num := 0
+	for _, r := range strings.TrimPrefix(strings.TrimPrefix(value, "+"), "P") {
+		switch {
+		case r >= '0' && r <= '9':
+			num = num*10 + int(r-'0')
+		case r == 'W':
+			d += time.Duration(num) * 7 * 24 * time.Hour
+			num = 0
+		case r == 'D':
+			d += time.Duration(num) * 24 * time.Hour
+			num = 0
+		case r == 'H':
+			d += time.Duration(num) * time.Hour
+			num = 0
+		case r == 'M':
+			d += time.Duration(num) * time.Minute
+			num = 0
+		case r == 'S':
+			d += time.Duration(num) * time.Second
+			num = 0
+		}
+	}
+	return d
+}
+
+func mergeIntervals(all []interval) []interval {
+	sort.Slice(all, func(i, j int) bool { return all[i].Start.Before(all[j].Start) })
+	var merged []interval
+	for _, iv := range all {
+		if n := len(merged); n > 0 && !iv.Start.After(merged[n-1].End) {
+			if iv.End.After(merged[n-1].End) {
+				merged[n-1].End = iv.End
+			}
+			continue
+		}
+		merged = append(merged, iv)
+	}
+	return merged
+}
@@ -0,0 +1,227 @@
+package main
+
+import (
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// recurrenceRule is the subset of an RFC 5545 RRULE that calendar exports
+// use for meetings: FREQ, INTERVAL, COUNT, UNTIL, BYDAY and BYMONTHDAY.
+// Other parts are ignored.
+type recurrenceRule struct {
+	freq       string // DAILY, WEEKLY, MONTHLY or YEARLY
+	interval   int
+	count      int
+	until      time.Time
+	byDay      []recurrenceDay
+	byMonthDay []int
+}
+
+// recurrenceDay is a BYDAY entry, the nth weekday of the month (or from
+// its end when negative), any of them when n is 0.
+type recurrenceDay struct {
+	n       int
+	weekday time.Weekday
+}
+
+var icsWeekdays = map[string]time.Weekday{
+	"SU": time.Sunday, "MO": time.Monday, "TU": time.Tuesday, "WE": time.Wednesday,
+	"TH": time.Thursday, "FR": time.Friday, "SA": time.Saturday,
+}
+
+// recurrenceMaxPeriods bounds the periods scanned by a rule whose
+// occurrences never fall on a valid date, such as BYMONTHDAY=30 yearly in
+// February.
+const recurrenceMaxPeriods = 100000
+
+// parseRecurrenceRule parses an RRULE value, nil if its frequency is not
+// supported. A date-only UNTIL is read in loc and includes that day.
+func parseRecurrenceRule(value string, loc *time.Location) *recurrenceRule {
+	rule := &recurrenceRule{interval: 1}
+	for _, part := range strings.Split(value, ";") {
+		name, value, _ := strings.Cut(part, "=")
+		switch name {
+		case "FREQ":
+			rule.freq = value
+		case "INTERVAL":
+			if n, err := strconv.Atoi(value); err == nil && n > 0 {
+				rule.interval = n
+			}
+		case "COUNT":
+			rule.count, _ = strconv.Atoi(value)
+		case "UNTIL":
+			if len(value) == len("20060102") {
+				if t, err := time.ParseInLocation("20060102", value, loc); err == nil {
+					rule.until = t.AddDate(0, 0, 1).Add(-time.Second)
+				}
+			} else {
+				rule.until = parseICSTime(nil, value)
+			}
+		case "BYDAY":
+			for _, day := range strings.Split(value, ",") {
+				if len(day) < 2 {
+					continue
+				}
+				weekday, ok := icsWeekdays[day[len(day)-2:]]
+				if !ok {
+					continue
+				}
+				n, _ := strconv.Atoi(day[:len(day)-2])
+				rule.byDay = append(rule.byDay, recurrenceDay{n: n, weekday: weekday})
+			}
+		case "BYMONTHDAY":
+			for _, day := range strings.Split(value, ",") {
+				if n, err := strconv.Atoi(day); err == nil && n != 0 {
+					rule.byMonthDay = append(rule.byMonthDay, n)
+				}
+			}
+		}
+	}
+	switch rule.freq {
+	case "DAILY", "WEEKLY", "MONTHLY", "YEARLY":
+		return rule
+	}
+	return nil
+}
+
+// expand calls occurrence with the start of each occurrence that ends after
+// from and starts before to, in order. The first occurrence is always
+// start, and COUNT counts occurrences from it, excluded ones included.
+func (rule *recurrenceRule) expand(start time.Time, duration time.Duration, from, to time.Time, occurrence func(time.Time)) {
+	period := 0
+	if rule.count == 0 && (rule.freq == "DAILY" || rule.freq == "WEEKLY") {
+		// without a count, skip the periods that end before from
+		days := 1
+		if rule.freq == "WEEKLY" {
+			days = 7
+		}
+		length := time.Duration(rule.interval*days) * 24 * time.Hour
+		if skip := int(from.Sub(start.Add(duration))/length) - 1; skip > 0 {
+			period = skip
+		}
+	}
+	count := 0
+	for end := period + recurrenceMaxPeriods; period < end; period++ {
+		for _, t := range rule.candidates(start, period) {
+			if t.Before(start) {
+				continue
+			}
+			if !rule.until.IsZero() && t.After(rule.until) {
+				return
+			}
+			if !t.Before(to) {
+				return
+			}
+			if count++; rule.count > 0 && count > rule.count {
+				return
+			}
+			if t.Add(duration).After(from) {
+				occurrence(t)
+			}
+		}
+	}
+}
+
+// candidates returns the sorted occurrence starts of a period of the rule,
+// at the time of day of start.
+func (rule *recurrenceRule) candidates(start time.Time, period int) []time.Time {
+	y, m, d := start.Date()
+	at := func(y int, m time.Month, d int) time.Time {
+		return time.Date(y, m, d, start.Hour(), start.Minute(), start.Second(), 0, start.Location())
+	}
+	var days []time.Time
+	switch rule.freq {
+	case "DAILY":
+		days = append(days, at(y, m, d+period*rule.interval))
+	case "WEEKLY":
+		base := at(y, m, d+7*period*rule.interval)
+		if len(rule.byDay) == 0 {
+			return []time.Time{base}
+		}
+		// weeks start on Monday
+		monday := base.AddDate(0, 0, -(int(base.Weekday())+6)%7)
+		for _, day := range rule.byDay {
+			days = append(days, monday.AddDate(0, 0, (int(day.weekday)+6)%7))
+		}
+	case "MONTHLY":
+		first := time.Date(y, m+time.Month(period*rule.interval), 1, 0, 0, 0, 0, start.Location())
+		days = rule.monthDays(first.Year(), first.Month(), d, at)
+	case "YEARLY":
+		days = rule.monthDays(y+period*rule.interval, m, d, at)
+	}
+	sort.Slice(days, func(i, j int) bool { return days[i].Before(days[j]) })
+	return days
+}
+
+// monthDays returns the days of a month selected by BYMONTHDAY or BYDAY,
+// or the day of the month of the first occurrence, skipped when the month
+// is too short.
+func (rule *recurrenceRule) monthDays(y int, m time.Month, day int, at func(int, time.Month, int) time.Time) []time.Time {
+	last := time.Date(y, m+1, 0, 0, 0, 0, 0, time.UTC).Day()
+	var days []time.Time
+	for _, d := range rule.byMonthDay {
+		if d < 0 {
+			d += last + 1
+		}
+		if d >= 1 && d <= last {
+			days = append(days, at(y, m, d))
+		}
+	}
+	for _, bd := range rule.byDay {
+		first := (int(bd.weekday)-int(time.Date(y, m, 1, 0, 0, 0, 0, time.UTC).Weekday())+7)%7 + 1
+		switch {
+		case bd.n == 0:
+			for d := first; d <= last; d += 7 {
+				days = append(days, at(y, m, d))
+			}
+		case bd.n > 0:
+			if d := first + 7*(bd.n-1); d <= last {
+				days = append(days, at(y, m, d))
+			}
+		default:
+			lastWeekday := first + 7*((last-first)/7)
+			if d := lastWeekday + 7*(bd.n+1); d >= 1 {
+				days = append(days, at(y, m, d))
+			}
+		}
+	}
+	if len(rule.byMonthDay) == 0 && len(rule.byDay) == 0 && day <= last {
+		days = append(days, at(y, m, day))
+	}
+	return days
+}
+
+// recurrenceExceptions holds the EXDATE values of an event, times or
+// whole days when given as VALUE=DATE.
+type recurrenceExceptions struct {
+	times map[int64]bool
+	days  map[string]bool
+}
+
+func (e *recurrenceExceptions) add(params []string, value string) {
+	date := false
+	for _, param := range params {
+		date = date || param == "VALUE=DATE"
+	}
+	for _, v := range strings.Split(value, ",") {
+		if date || len(v) == len("20060102") {
+			if e.days == nil {
+				e.days = make(map[string]bool)
+			}
+			e.days[v] = true
+			continue
+		}
+		if t := parseICSTime(params, v); !t.IsZero() {
+			if e.times == nil {
+				e.times = make(map[int64]bool)
+			}
+			e.times[t.Unix()] = true
+		}
+	}
+}
+
+func (e *recurrenceExceptions) match(t time.Time) bool {
+	return e.times[t.Unix()] || e.days[t.Format("20060102")]
+}
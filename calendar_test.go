@@ -0,0 +1,126 @@
+package main
+
+import (
+	"fmt"
+	"io"
+	"log"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+	"time"
+)
+
+func icsEvent(lines ...string) string {
+	return "BEGIN:VEVENT\r\n" + strings.Join(lines, "\r\n") + "\r\nEND:VEVENT\r\n"
+}
+
+func TestExpandRecurrence(t *testing.T) {
+	from := time.Date(2026, 1, 1, 0, 0, 0, 0, time.UTC)
+	to := from.AddDate(0, 3, 0)
+	at := func(month time.Month, day, hour int) time.Time {
+		return time.Date(2026, month, day, hour, 0, 0, 0, time.UTC)
+	}
+	for _, c := range []struct {
+		name   string
+		events []string
+		want   []time.Time // occurrence starts
+	}{
+		{"weekly by day with count and exdate", []string{icsEvent(
+			"DTSTART:20260105T090000Z", "DTEND:20260105T093000Z",
+			"RRULE:FREQ=WEEKLY;BYDAY=MO,WE;COUNT=4", "EXDATE:20260107T090000Z",
+		)}, []time.Time{at(1, 5, 9), at(1, 12, 9), at(1, 14, 9)}},
+		{"every other day until", []string{icsEvent(
+			"DTSTART:20260105T090000Z", "DURATION:PT1H",
+			"RRULE:FREQ=DAILY;INTERVAL=2;UNTIL=20260109",
+		)}, []time.Time{at(1, 5, 9), at(1, 7, 9), at(1, 9, 9)}},
+		{"last friday of the month", []string{icsEvent(
+			"DTSTART:20260130T160000Z", "DTEND:20260130T170000Z",
+			"RRULE:FREQ=MONTHLY;BYDAY=-1FR",
+		)}, []time.Time{at(1, 30, 16), at(2, 27, 16), at(3, 27, 16)}},
+		{"31st skips short months", []string{icsEvent(
+			"DTSTART:20260131T100000Z", "DTEND:20260131T110000Z",
+			"RRULE:FREQ=MONTHLY",
+		)}, []time.Time{at(1, 31, 10), at(3, 31, 10)}},
+		{"moved and cancelled instances", []string{
+			icsEvent("UID:a", "DTSTART:20260105T090000Z", "DTEND:20260105T093000Z", "RRULE:FREQ=WEEKLY;COUNT=3"),
+			icsEvent("UID:a", "RECURRENCE-ID:20260112T090000Z", "DTSTART:20260112T140000Z", "DTEND:20260112T143000Z"),
+			icsEvent("UID:a", "RECURRENCE-ID:20260119T090000Z", "DTSTART:20260119T090000Z", "DTEND:20260119T093000Z", "STATUS:CANCELLED"),
+		}, []time.Time{at(1, 5, 9), at(1, 12, 14)}},
+		{"started long ago", []string{icsEvent(
+			"DTSTART:20150105T090000Z", "DTEND:20150105T093000Z",
+			"RRULE:FREQ=WEEKLY;INTERVAL=4",
+		)}, []time.Time{at(1, 19, 9), at(2, 16, 9), at(3, 16, 9)}},
+	} {
+		var events []*calendarEvent
+		for _, raw := range splitEvents([]byte(strings.Join(c.events, ""))) {
+			if event := parseEvent(raw); event != nil {
+				events = append(events, event)
+			}
+		}
+		windows := mergeIntervals(expandEvents(events, from, to))
+		var got []time.Time
+		for _, w := range windows {
+			got = append(got, w.Start.UTC())
+		}
+		if fmt.Sprint(got) != fmt.Sprint(c.want) {
+			t.Errorf("%s: occurrences %v, want %v", c.name, got, c.want)
+		}
+	}
+}
+
+// writeBenchmarkCalendar writes n events over a year, a tenth of them weekly.
+func writeBenchmarkCalendar(b *testing.B, n int) string {
+	b.Helper()
+	start := time.Now().Truncate(time.Hour)
+	var ics strings.Builder
+	ics.WriteString("BEGIN:VCALENDAR\r\n")
+	for i := 0; i < n; i++ {
+		t := start.Add(time.Duration(i%8760) * time.Hour).UTC()
+		lines := []string{
+			fmt.Sprintf("UID:%d", i),
+			"DTSTART:" + t.Format("20060102T150405Z"),
+			"DTEND:" + t.Add(30*time.Minute).Format("20060102T150405Z"),
+			fmt.Sprintf("SUMMARY:Meeting %d", i),
+		}
+		if i%10 == 0 {
+			lines = append(lines, "RRULE:FREQ=WEEKLY;BYDAY=MO,TH")
+		}
+		ics.WriteString(icsEvent(lines...))
+	}
+	ics.WriteString("END:VCALENDAR\r\n")
+	path := filepath.Join(b.TempDir(), "calendar.ics")
+	if err := os.WriteFile(path, []byte(ics.String()), 0644); err != nil {
+		b.Fatal(err)
+	}
+	return path
+}
+
+func BenchmarkCalendarLoad(b *testing.B) {
+	log.SetOutput(io.Discard)
+	defer log.SetOutput(os.Stderr)
+	path := writeBenchmarkCalendar(b, 50000)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := NewCalendar(path).Load(); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// BenchmarkCalendarReload reloads an unchanged file, every block is reused.
+func BenchmarkCalendarReload(b *testing.B) {
+	log.SetOutput(io.Discard)
+	defer log.SetOutput(os.Stderr)
+	path := writeBenchmarkCalendar(b, 50000)
+	c := NewCalendar(path)
+	if err := c.Load(); err != nil {
+		b.Fatal(err)
+	}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := c.Load(); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
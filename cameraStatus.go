@@ -0,0 +1,91 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Video.h"
+extern void goCamerastatusfunc(unsigned short deviceID, unsigned char status);
+*/
+import "C"
+import (
+	"sync/atomic"
+	"time"
+)
+
+// cameraStreaming has a bit per device ID set while the camera streams, it
+// and the counters below are only updated with atomics so status callbacks
+// of several cameras never wait on each other before setBusy. setBusy
+// itself takes busyLock, and logs and records telemetry when the light
+// changes.
+var cameraStreaming [1 << 16 / 64]uint64
+var cameraStreamingCount int32
+
+// event to busy light latencies, in nanoseconds
+var cameraEvents, cameraLatencySum, cameraLatencyMax, cameraLatencyLast int64
+
+type CameraStats struct {
+	Streaming      int
+	Events         int64
+	LatencyLast    time.Duration
+	LatencyMax     time.Duration
+	LatencyAverage time.Duration
+}
+
+func registerCameraStatus() {
+	C.Jabra_RegisterCameraStatusCallback((*[0]byte)(C.goCamerastatusfunc))
+	registerStats("camera", cameraStats)
+}
+
+// setCameraStreaming updates the bit of a device and returns whether any camera streams.
+func setCameraStreaming(deviceID uint16, streaming bool) bool {
+	word, bit := &cameraStreaming[deviceID/64], uint64(1)<<(deviceID%64)
+	for {
+		old := atomic.LoadUint64(word)
+		value := old &^ bit
+		if streaming {
+			value |= bit
+		}
+		if value == old {
+			return atomic.LoadInt32(&cameraStreamingCount) > 0
+		}
+		if atomic.CompareAndSwapUint64(word, old, value) {
+			if streaming {
+				return atomic.AddInt32(&cameraStreamingCount, 1) > 0
+			}
+			return atomic.AddInt32(&cameraStreamingCount, -1) > 0
+		}
+	}
+}
+
+//export goCamerastatusfunc
+func goCamerastatusfunc(deviceid uint16, status bool) {
+	start := time.Now()
+	setBusy(busySourceCamera, setCameraStreaming(deviceid, status))
+	latency := int64(time.Since(start))
+	atomic.AddInt64(&cameraEvents, 1)
+	atomic.AddInt64(&cameraLatencySum, latency)
+	atomic.StoreInt64(&cameraLatencyLast, latency)
+	for {
+		max := atomic.LoadInt64(&cameraLatencyMax)
+		if latency <= max || atomic.CompareAndSwapInt64(&cameraLatencyMax, max, latency) {
+			break
+		}
+	}
+}
+
+func removeCameraStatus(device *DeviceInfo) {
+	setBusy(busySourceCamera, setCameraStreaming(device.DeviceID, false))
+}
+
+func cameraStats() interface{} {
+	stats := CameraStats{
+		Streaming:   int(atomic.LoadInt32(&cameraStreamingCount)),
+		Events:      atomic.LoadInt64(&cameraEvents),
+		LatencyLast: time.Duration(atomic.LoadInt64(&cameraLatencyLast)),
+		LatencyMax:  time.Duration(atomic.LoadInt64(&cameraLatencyMax)),
+	}
+	if stats.Events > 0 {
+		stats.LatencyAverage = time.Duration(atomic.LoadInt64(&cameraLatencySum) / stats.Events)
+	}
+	return stats
+}
@@ -0,0 +1,193 @@
+package main
+
+import (
+	"encoding/json"
+	"hash/fnv"
+	"log"
+	"net/http"
+	"sort"
+)
+
+// ComplianceDiff is a setting that differs from the baseline.
+type ComplianceDiff struct {
+	GUID     string
+	Name     string
+	Expected string
+	Actual   string
+}
+
+type DeviceCompliance struct {
+	SerialNumber string
+	DeviceName   string
+	Compliant    bool
+	Fingerprint  uint64
+	Diffs        []ComplianceDiff `json:",omitempty"`
+}
+
+// manifestBaseline is the baseline profile resolved for one manifest. The
+// fingerprint of a device is the XOR of the hashes of its GUID/value pairs
+// over the baseline settings, so it is updated in O(1) per changed value.
+type manifestBaseline struct {
+	manifest  *SettingsManifest
+	positions []int
+	values    map[int]string // normalized expected values, by position
+	expected  uint64
+}
+
+func settingPairHash(guid string, value string) uint64 {
+	h := fnv.New64a()
+	h.Write([]byte(guid))
+	h.Write([]byte{0})
+	h.Write([]byte(value))
+	return h.Sum64()
+}
+
+func (b *manifestBaseline) fingerprint(values []string) uint64 {
+	if b == nil {
+		return 0
+	}
+	return b.fingerprintOf(func(i int) string { return values[i] })
+}
+
+func (b *manifestBaseline) fingerprintOf(value func(i int) string) uint64 {
+	fingerprint := uint64(0)
+	for _, i := range b.positions {
+		fingerprint ^= settingPairHash(b.manifest.Settings[i].GUID, value(i))
+	}
+	return fingerprint
+}
+
+func (b *manifestBaseline) update(fingerprint uint64, i int, old string, value string) uint64 {
+	if b == nil {
+		return 0
+	}
+	if _, ok := b.values[i]; !ok {
+		return fingerprint
+	}
+	guid := b.manifest.Settings[i].GUID
+	return fingerprint ^ settingPairHash(guid, old) ^ settingPairHash(guid, value)
+}
+
+// ComplianceBaseline compares devices against a baseline profile of setting values by GUID.
+type ComplianceBaseline struct {
+	Profile   map[string]string
+	manifests map[*SettingsManifest]*manifestBaseline
+}
+
+// complianceBaseline is nil unless the daemon was started with -compliance-baseline.
+var complianceBaseline *ComplianceBaseline
+
+func NewComplianceBaseline(profile map[string]string) *ComplianceBaseline {
+	return &ComplianceBaseline{Profile: profile, manifests: make(map[*SettingsManifest]*manifestBaseline)}
+}
+
+// forManifest resolves the baseline for a manifest once, settingsLock must be held.
+func (c *ComplianceBaseline) forManifest(m *SettingsManifest) *manifestBaseline {
+	if c == nil {
+		return nil
+	}
+	if b, ok := c.manifests[m]; ok {
+		return b
+	}
+	b := &manifestBaseline{manifest: m, values: make(map[int]string, len(c.Profile))}
+	for guid, value := range c.Profile {
+		i, ok := m.lookup(guid)
+		if !ok {
+			continue
+		}
+		normalized, err := m.Settings[i].normalize(value)
+		if err != nil {
+			log.Println("compliance:", err)
+			continue
+		}
+		b.positions = append(b.positions, i)
+		b.values[i] = normalized
+	}
+	sort.Ints(b.positions)
+	b.expected = b.fingerprintOf(func(i int) string { return b.values[i] })
+	c.manifests[m] = b
+	return b
+}
+
+// checkCompliance compares the fingerprint of a device with the baseline
+// and only rebuilds the diff when the fingerprint changed, settingsLock must be held.
+func (ds *deviceSettings) checkCompliance() {
+	if ds.baseline == nil || (ds.compliance.SerialNumber != "" && ds.compliance.Fingerprint == ds.fingerprint) {
+		return
+	}
+	compliance := DeviceCompliance{
+		SerialNumber: ds.device.SerialNumber,
+		DeviceName:   ds.device.DeviceName,
+		Compliant:    ds.fingerprint == ds.baseline.expected,
+		Fingerprint:  ds.fingerprint,
+	}
+	if !compliance.Compliant {
+		for _, i := range ds.baseline.positions {
+			if ds.values[i] != ds.baseline.values[i] {
+				compliance.Diffs = append(compliance.Diffs, ComplianceDiff{
+					GUID:     ds.manifest.Settings[i].GUID,
+					Name:     ds.manifest.Settings[i].Name,
+					Expected: ds.baseline.values[i],
+					Actual:   ds.values[i],
+				})
+			}
+		}
+		if ds.compliance.Compliant || ds.compliance.SerialNumber == "" {
+			log.Printf("compliance: %s drifts from the baseline on %d settings", ds.device.DeviceName, len(compliance.Diffs))
+		}
+	}
+	ds.compliance = compliance
+}
+
+// checkComplianceOnAttach loads the settings of a new device so it gets a fingerprint.
+func checkComplianceOnAttach(device *DeviceInfo) {
+	if complianceBaseline == nil || device.IsDongle {
+		return
+	}
+	backgroundWorker.Submit(func() {
+		if _, err := loadDeviceSettings(device); err != nil {
+			log.Println("compliance:", err)
+		}
+	})
+}
+
+// serveCompliance streams one JSON line per attached device, from the cache.
+func serveCompliance(w http.ResponseWriter, r *http.Request) {
+	if complianceBaseline == nil {
+		http.Error(w, "no compliance baseline", http.StatusNotFound)
+		return
+	}
+	settingsLock.Lock()
+	ids := make([]uint16, 0, len(settingsDevices))
+	for id := range settingsDevices {
+		ids = append(ids, id)
+	}
+	settingsLock.Unlock()
+	sort.Slice(ids, func(a, b int) bool { return ids[a] < ids[b] })
+
+	w.Header().Set("Content-Type", "application/x-ndjson")
+	encoder := json.NewEncoder(w)
+	flusher, _ := w.(http.Flusher)
+	for _, id := range ids {
+		settingsLock.Lock()
+		ds, ok := settingsDevices[id]
+		var compliance DeviceCompliance
+		if ok {
+			compliance = ds.compliance
+		}
+		settingsLock.Unlock()
+		if !ok {
+			continue
+		}
+		if err := encoder.Encode(&compliance); err != nil {
+			return
+		}
+		if flusher != nil {
+			flusher.Flush()
+		}
+	}
+}
+
+func init() {
+	statsMux.HandleFunc("/compliance", serveCompliance)
+}
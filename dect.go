@@ -0,0 +1,177 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+extern void goDectinfofunc(unsigned short deviceID, Jabra_DectInfo* dectInfo);
+
+static inline Jabra_DectInfoDensity* dectInfoDensity(Jabra_DectInfo* info) { return &info->DectDensity; }
+static inline Jabra_DectErrorCount* dectInfoErrorCount(Jabra_DectInfo* info) { return &info->DectErrorCount; }
+*/
+import "C"
+import (
+	"log"
+	"strconv"
+	"sync"
+)
+
+const (
+	dectWindow = 32
+	// handovers from this count on are audible when they last multiple consecutive readings
+	dectHandoverThreshold = 5
+	dectHandoverReadings  = 2
+)
+
+// dectWindowRing keeps the last dectWindow readings of a value.
+type dectWindowRing struct {
+	values [dectWindow]float64
+	next   int
+	count  int
+}
+
+func (r *dectWindowRing) push(v float64) {
+	r.values[r.next] = v
+	r.next = (r.next + 1) % dectWindow
+	if r.count < dectWindow {
+		r.count++
+	}
+}
+
+func (r *dectWindowRing) at(i int) float64 {
+	return r.values[(r.next-r.count+i+dectWindow)%dectWindow]
+}
+
+func (r *dectWindowRing) average(from, to int) float64 {
+	if to <= from {
+		return 0
+	}
+	sum := 0.0
+	for i := from; i < to; i++ {
+		sum += r.at(i)
+	}
+	return sum / float64(to-from)
+}
+
+// trend is the average of the newer half of the window minus the older half.
+func (r *dectWindowRing) trend() float64 {
+	half := r.count / 2
+	return r.average(half, r.count) - r.average(0, half)
+}
+
+type DectStats struct {
+	Density              float64 // last percentage density
+	DensityAverage       float64
+	DensityTrend         float64
+	Handovers            uint16 // last handover count
+	HandoversAverage     float64
+	HandoversTrend       float64
+	SyncErrors           uint16
+	HubSyncErrors        uint16
+	ConsecutiveHandovers int // consecutive readings at or above the handover threshold
+}
+
+type dectDevice struct {
+	density   dectWindowRing
+	handovers dectWindowRing
+	stats     DectStats
+}
+
+var dectDevices = make(map[uint16]*dectDevice, 0)
+var dectLock = sync.Mutex{}
+
+func registerDectInfo() {
+	C.Jabra_RegisterDectInfoHandler((*[0]byte)(C.goDectinfofunc))
+	registerStats("dect", dectStats)
+}
+
+// dectDensityPercent is the "percentage density" documented in Common.h.
+func dectDensityPercent(density *C.Jabra_DectInfoDensity) float64 {
+	if density.SumMeasuredRSSI == 0 {
+		return 0
+	}
+	return 100 * float64(density.MaximumReferenceRSSI) * float64(density.NumberMeasuredSlots) / float64(density.SumMeasuredRSSI)
+}
+
+//export goDectinfofunc
+func goDectinfofunc(deviceid uint16, info *C.Jabra_DectInfo) {
+	if info == nil {
+		return
+	}
+	defer C.Jabra_FreeDectInfoStr(info)
+
+	dectLock.Lock()
+	defer dectLock.Unlock()
+	device, ok := dectDevices[deviceid]
+	if !ok {
+		device = &dectDevice{}
+		dectDevices[deviceid] = device
+	}
+	stats := &device.stats
+
+	switch info.DectType {
+	case C.DectDensity:
+		density := dectDensityPercent(C.dectInfoDensity(info))
+		device.density.push(density)
+		stats.Density = density
+		stats.DensityAverage = device.density.average(0, device.density.count)
+		stats.DensityTrend = device.density.trend()
+	case C.DectErrorCount:
+		errors := C.dectInfoErrorCount(info)
+		handovers := uint16(errors.handoversCount)
+		device.handovers.push(float64(handovers))
+		stats.Handovers = handovers
+		stats.HandoversAverage = device.handovers.average(0, device.handovers.count)
+		stats.HandoversTrend = device.handovers.trend()
+		stats.SyncErrors = uint16(errors.syncErrors)
+		stats.HubSyncErrors = uint16(errors.hubSyncErrors)
+		if handovers >= dectHandoverThreshold {
+			stats.ConsecutiveHandovers++
+		} else {
+			stats.ConsecutiveHandovers = 0
+		}
+		if stats.ConsecutiveHandovers == dectHandoverReadings {
+			log.Printf("DECT alert on device %d: %d handovers in %d consecutive readings, density %.0f%%, audio dropouts are likely",
+				deviceid, handovers, dectHandoverReadings, stats.Density)
+		}
+	default:
+		return
+	}
+
+	deviceListLock.Lock()
+	d, ok := deviceList[deviceid]
+	deviceListLock.Unlock()
+	if ok {
+		if info.DectType == C.DectDensity {
+			telemetry.Append(d.SerialNumber, TelemetryDectDensity, int64(stats.Density))
+		} else {
+			telemetry.Append(d.SerialNumber, TelemetryDectHandovers, int64(stats.Handovers))
+		}
+	}
+}
+
+// DectInfo returns the DECT radio statistics of a device.
+func DectInfo(deviceID uint16) (DectStats, bool) {
+	dectLock.Lock()
+	defer dectLock.Unlock()
+	device, ok := dectDevices[deviceID]
+	if !ok {
+		return DectStats{}, false
+	}
+	return device.stats, true
+}
+
+func removeDectInfo(deviceID uint16) {
+	dectLock.Lock()
+	defer dectLock.Unlock()
+	delete(dectDevices, deviceID)
+}
+
+func dectStats() interface{} {
+	dectLock.Lock()
+	defer dectLock.Unlock()
+	stats := make(map[string]DectStats, len(dectDevices))
+	for deviceID, device := range dectDevices {
+		stats[strconv.Itoa(int(deviceID))] = device.stats
+	}
+	return stats
+}
@@ -56,6 +56,11 @@ func (d *DeviceInfo) SetBusylightStatus(value bool) {
 	}
 	d.BusylightStatus = value
 	C.Jabra_SetBusylightStatus(C.ushort(d.DeviceID), C.bool(value))
+	if value {
+		telemetry.Append(d.SerialNumber, TelemetryBusylight, 1)
+	} else {
+		telemetry.Append(d.SerialNumber, TelemetryBusylight, 0)
+	}
 	log.Printf("Set busy light on %s to %t", d.DeviceName, d.BusylightStatus)
 }
 
@@ -0,0 +1,363 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Network.h"
+extern void goDiagnosticlogreadyfunc(unsigned short deviceID);
+*/
+import "C"
+import (
+	"compress/gzip"
+	"context"
+	"errors"
+	"fmt"
+	"io"
+	"log"
+	"net/http"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+const (
+	// how long a device may take to generate its log once triggered
+	diagnosticLogTimeout = 5 * time.Minute
+	// logs are compressed through a buffer of this size, never read whole
+	diagnosticLogChunk = 64 << 10
+)
+
+type DiagnosticLog struct {
+	Name string
+	Size int64
+	Time time.Time
+}
+
+type DiagnosticLogStats struct {
+	Active       []string
+	Collected    int
+	Failed       int
+	ArchiveBytes int64
+	MaxBytes     int64
+	LastError    string `json:",omitempty"`
+}
+
+// DiagnosticLogCollector triggers the generation of device diagnostic logs
+// and keeps them gzip compressed in Dir, the oldest logs are deleted once
+// the archive grows over MaxBytes.
+type DiagnosticLogCollector struct {
+	Dir      string
+	MaxBytes int64
+	lock     sync.Mutex
+	ready    map[uint16]chan struct{} // devices waiting for their log, by device ID
+	active   map[string]bool          // by serial number
+	stats    DiagnosticLogStats
+	slots    chan struct{}
+}
+
+// diagnosticLogs is nil unless the daemon was started with -diagnostic-logs.
+var diagnosticLogs *DiagnosticLogCollector
+
+func NewDiagnosticLogCollector(dir string, maxBytes int64, parallel int) (*DiagnosticLogCollector, error) {
+	if parallel < 1 {
+		parallel = 1
+	}
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return nil, err
+	}
+	c := &DiagnosticLogCollector{
+		Dir:      dir,
+		MaxBytes: maxBytes,
+		ready:    make(map[uint16]chan struct{}),
+		active:   make(map[string]bool),
+		slots:    make(chan struct{}, parallel),
+	}
+	c.stats.MaxBytes = maxBytes
+	// downloads interrupted by a restart
+	if tmps, err := filepath.Glob(filepath.Join(dir, "*.tmp")); err == nil {
+		for _, tmp := range tmps {
+			os.Remove(tmp)
+		}
+	}
+	if err := c.trim(); err != nil {
+		return nil, err
+	}
+	registerStats("diagnostics", c.statsSnapshot)
+	return c, nil
+}
+
+func registerDiagnosticLogs() {
+	C.Jabra_RegisterDiagnosticLogCallback((*[0]byte)(C.goDiagnosticlogreadyfunc))
+}
+
+//export goDiagnosticlogreadyfunc
+func goDiagnosticlogreadyfunc(deviceid uint16) {
+	c := diagnosticLogs
+	if c == nil {
+		return
+	}
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if ready, ok := c.ready[deviceid]; ok {
+		close(ready)
+		delete(c.ready, deviceid)
+	}
+}
+
+// CollectAsync starts collecting the log of a device unless it is already
+// being collected, it is safe to call on a nil collector.
+func (c *DiagnosticLogCollector) CollectAsync(deviceID uint16, serialNumber string, reason string) {
+	if c == nil {
+		return
+	}
+	go func() {
+		if _, err := c.Collect(context.Background(), deviceID, serialNumber, reason); err != nil {
+			log.Printf("diagnostics: collecting the log of %s failed: %v", serialNumber, err)
+		}
+	}()
+}
+
+// Collect triggers the generation of the log of a device, waits for it and
+// archives it. At most the -diagnostic-parallel collections run at once, the
+// wait for a slot and for the log ends with ctx.
+func (c *DiagnosticLogCollector) Collect(ctx context.Context, deviceID uint16, serialNumber string, reason string) (DiagnosticLog, error) {
+	c.lock.Lock()
+	if c.active[serialNumber] {
+		c.lock.Unlock()
+		return DiagnosticLog{}, errors.New("diagnostic log of " + serialNumber + " already being collected")
+	}
+	c.active[serialNumber] = true
+	c.lock.Unlock()
+
+	var entry DiagnosticLog
+	var err error
+	select {
+	case c.slots <- struct{}{}:
+		entry, err = c.collect(ctx, deviceID, serialNumber, reason)
+		<-c.slots
+	case <-ctx.Done():
+		err = ctx.Err()
+	}
+
+	c.lock.Lock()
+	delete(c.active, serialNumber)
+	if err != nil {
+		c.stats.Failed++
+		c.stats.LastError = serialNumber + ": " + err.Error()
+	} else {
+		c.stats.Collected++
+	}
+	c.lock.Unlock()
+	return entry, err
+}
+
+func (c *DiagnosticLogCollector) collect(ctx context.Context, deviceID uint16, serialNumber string, reason string) (DiagnosticLog, error) {
+	id := C.ushort(deviceID)
+	ready := make(chan struct{})
+	c.lock.Lock()
+	c.ready[deviceID] = ready
+	c.lock.Unlock()
+	defer func() {
+		c.lock.Lock()
+		if c.ready[deviceID] == ready {
+			delete(c.ready, deviceID)
+		}
+		c.lock.Unlock()
+	}()
+
+	var ret C.Jabra_ReturnCode
+	if !backgroundWorker.Do(func() { ret = C.Jabra_TriggerDiagnosticLogGeneration(id) }) {
+		return DiagnosticLog{}, errors.New("device worker queue full")
+	}
+	switch ret {
+	case C.Return_Ok:
+		select {
+		case <-ready:
+		case <-time.After(diagnosticLogTimeout):
+			return DiagnosticLog{}, errors.New("timed out waiting for the diagnostic log")
+		case <-ctx.Done():
+			return DiagnosticLog{}, ctx.Err()
+		}
+	case C.Not_Supported:
+		// the log is always ready on devices that cannot be triggered
+	default:
+		return DiagnosticLog{}, fmt.Errorf("failed to trigger diagnostic log generation: %d", int(ret))
+	}
+
+	// the SDK only writes the log to a file, it is compressed from there into
+	// the archive, only the compressed log counts against MaxBytes
+	raw := filepath.Join(os.TempDir(), fmt.Sprintf("jabra-%s-%d.log", serialNumber, time.Now().UnixNano()))
+	defer os.Remove(raw)
+	craw := C.CString(raw)
+	defer C.free(unsafe.Pointer(craw))
+	if !backgroundWorker.Do(func() { ret = C.Jabra_GetDiagnosticLogFile(id, craw) }) {
+		return DiagnosticLog{}, errors.New("device worker queue full")
+	}
+	if ret != C.Return_Ok {
+		return DiagnosticLog{}, fmt.Errorf("failed to read diagnostic log: %d", int(ret))
+	}
+
+	now := time.Now()
+	name := fmt.Sprintf("%s-%s-%s.log.gz", serialNumber, now.UTC().Format("20060102T150405Z"), reason)
+	size, err := c.compress(raw, filepath.Join(c.Dir, name))
+	if err != nil {
+		return DiagnosticLog{}, err
+	}
+	if err := c.trim(); err != nil {
+		log.Println("diagnostics:", err)
+	}
+	log.Printf("diagnostics: archived the %s log of %s, %d bytes", reason, serialNumber, size)
+	return DiagnosticLog{Name: name, Size: size, Time: now}, nil
+}
+
+// limitedWriter fails once more than n bytes are written through it.
+type limitedWriter struct {
+	w io.Writer
+	n int64
+}
+
+func (l *limitedWriter) Write(p []byte) (int, error) {
+	if int64(len(p)) > l.n {
+		return 0, errors.New("compressed diagnostic log larger than the archive")
+	}
+	l.n -= int64(len(p))
+	return l.w.Write(p)
+}
+
+// compress streams a raw log into a gzip file chunk by chunk and returns
+// the compressed size.
+func (c *DiagnosticLogCollector) compress(raw string, path string) (int64, error) {
+	in, err := os.Open(raw)
+	if err != nil {
+		return 0, err
+	}
+	defer in.Close()
+	tmp := path + ".tmp"
+	out, err := os.Create(tmp)
+	if err != nil {
+		return 0, err
+	}
+	defer os.Remove(tmp)
+	defer out.Close()
+
+	limit := &limitedWriter{w: out, n: c.MaxBytes}
+	zw := gzip.NewWriter(limit)
+	if _, err := io.CopyBuffer(zw, in, make([]byte, diagnosticLogChunk)); err != nil {
+		return 0, err
+	}
+	if err := zw.Close(); err != nil {
+		return 0, err
+	}
+	if err := out.Sync(); err != nil {
+		return 0, err
+	}
+	if err := out.Close(); err != nil {
+		return 0, err
+	}
+	if err := os.Rename(tmp, path); err != nil {
+		return 0, err
+	}
+	return c.MaxBytes - limit.n, nil
+}
+
+// List returns the archived logs, oldest first.
+func (c *DiagnosticLogCollector) List() ([]DiagnosticLog, error) {
+	entries, err := os.ReadDir(c.Dir)
+	if err != nil {
+		return nil, err
+	}
+	var logs []DiagnosticLog
+	for _, entry := range entries {
+		if !strings.HasSuffix(entry.Name(), ".log.gz") {
+			continue
+		}
+		info, err := entry.Info()
+		if err != nil {
+			continue
+		}
+		logs = append(logs, DiagnosticLog{Name: entry.Name(), Size: info.Size(), Time: info.ModTime()})
+	}
+	sort.Slice(logs, func(i, j int) bool { return logs[i].Time.Before(logs[j].Time) })
+	return logs, nil
+}
+
+// trim deletes the oldest logs until the archive fits in MaxBytes.
+func (c *DiagnosticLogCollector) trim() error {
+	logs, err := c.List()
+	if err != nil {
+		return err
+	}
+	var total int64
+	for _, l := range logs {
+		total += l.Size
+	}
+	for len(logs) > 0 && total > c.MaxBytes {
+		if err := os.Remove(filepath.Join(c.Dir, logs[0].Name)); err != nil && !os.IsNotExist(err) {
+			return err
+		}
+		total -= logs[0].Size
+		logs = logs[1:]
+	}
+	c.lock.Lock()
+	c.stats.ArchiveBytes = total
+	c.lock.Unlock()
+	return nil
+}
+
+func (c *DiagnosticLogCollector) statsSnapshot() interface{} {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	stats := c.stats
+	stats.Active = make([]string, 0, len(c.active))
+	for serialNumber := range c.active {
+		stats.Active = append(stats.Active, serialNumber)
+	}
+	sort.Strings(stats.Active)
+	return stats
+}
+
+// serveDiagnostics lists the archived logs (GET), returns one with ?name=
+// or collects the log of ?serial= (POST) and returns its archive entry.
+func serveDiagnostics(w http.ResponseWriter, r *http.Request) {
+	if diagnosticLogs == nil {
+		http.Error(w, "no diagnostic log archive", http.StatusNotFound)
+		return
+	}
+	if r.Method == http.MethodPost {
+		device := findDevice(r.URL.Query().Get("serial"))
+		if device == nil {
+			http.Error(w, "no attached device "+r.URL.Query().Get("serial"), http.StatusNotFound)
+			return
+		}
+		entry, err := diagnosticLogs.Collect(r.Context(), device.DeviceID, device.SerialNumber, "manual")
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadGateway)
+			return
+		}
+		writeJSON(w, entry)
+		return
+	}
+	if name := r.URL.Query().Get("name"); name != "" {
+		if name != filepath.Base(name) || !strings.HasSuffix(name, ".log.gz") {
+			http.Error(w, "invalid log name", http.StatusBadRequest)
+			return
+		}
+		w.Header().Set("Content-Type", "application/gzip")
+		http.ServeFile(w, r, filepath.Join(diagnosticLogs.Dir, name))
+		return
+	}
+	logs, err := diagnosticLogs.List()
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusInternalServerError)
+		return
+	}
+	writeJSON(w, logs)
+}
+
+func init() {
+	registerControl("/diagnostics", serveDiagnostics)
+}
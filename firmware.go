@@ -0,0 +1,500 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Firmware.h"
+#include "jabra/JabraDeviceConfig.h"
+extern void goFirmwareprogressfunc(unsigned short deviceID, Jabra_FirmwareEventType type, Jabra_FirmwareEventStatus status, unsigned short percentage);
+*/
+import "C"
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"log"
+	"net/http"
+	"os"
+	"path/filepath"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+// firmwareTimeout bounds a single download or update, the SDK reports both
+// through the progress callback only.
+const firmwareTimeout = 30 * time.Minute
+
+var firmwareStatusNames = map[int]string{
+	C.Initiating: "initiating", C.InProgress: "in progress", C.Completed: "completed", C.Cancelled: "cancelled",
+	C.File_NotAvailable: "file not available", C.File_NotAccessible: "file not accessible",
+	C.File_AlreadyPresent: "file already present", C.Network_Error: "network error", C.SSL_Error: "SSL error",
+	C.Download_Error: "download error", C.Update_Error: "update error", C.Invalid_Authentication: "invalid authentication",
+	C.File_UnderDownload: "file under download", C.Not_Allowed: "not allowed", C.Sdk_TooOldForUpdate: "SDK too old for update",
+}
+
+// FirmwareProgress is the state of the last firmware update of a device.
+type FirmwareProgress struct {
+	DeviceName string
+	Version    string `json:",omitempty"`
+	Stage      string // scheduled, checking, downloading, queued, updating, updated, up to date, locked or failed
+	Percentage int
+	Error      string `json:",omitempty"`
+	Started    time.Time
+	Updated    time.Time
+	// extrapolated from the progress events of the current download or update
+	EstimatedCompletion time.Time
+}
+
+// firmwareJob is a download or an update waiting for the progress callback.
+type firmwareJob struct {
+	progress *FirmwareProgress
+	update   bool
+	started  time.Time
+	done     chan int      // terminal status
+	removed  chan struct{} // closed when the device is removed
+	gone     bool
+}
+
+type firmwareDownload struct {
+	done chan struct{}
+	hash string
+	err  error
+}
+
+// FirmwareUpdater updates devices to their latest firmware. Images are
+// downloaded once per product and version through the SDK, then kept in a
+// content-addressed cache (blobs named by their SHA-256) that every device
+// with the same product is updated from.
+type FirmwareUpdater struct {
+	Dir             string
+	AuthorizationID string
+	lock            sync.Mutex
+	index           map[string]string // sha256 of the image, by "<product id>/<version>"
+	downloads       map[string]*firmwareDownload
+	active          map[uint16]*firmwareJob
+	progress        map[string]*FirmwareProgress // by serial number
+	slots           chan struct{}
+}
+
+// firmware is nil unless the daemon was started with -firmware-cache.
+var firmware *FirmwareUpdater
+
+func NewFirmwareUpdater(dir string, authorizationID string, parallel int) (*FirmwareUpdater, error) {
+	if parallel < 1 {
+		parallel = 1
+	}
+	if err := os.MkdirAll(filepath.Join(dir, "sha256"), 0755); err != nil {
+		return nil, err
+	}
+	u := &FirmwareUpdater{
+		Dir:             dir,
+		AuthorizationID: authorizationID,
+		index:           make(map[string]string),
+		downloads:       make(map[string]*firmwareDownload),
+		active:          make(map[uint16]*firmwareJob),
+		progress:        make(map[string]*FirmwareProgress),
+		slots:           make(chan struct{}, parallel),
+	}
+	data, err := os.ReadFile(filepath.Join(dir, "index.json"))
+	if err == nil {
+		if err := json.Unmarshal(data, &u.index); err != nil {
+			log.Println("firmware:", err)
+		}
+	} else if !os.IsNotExist(err) {
+		return nil, err
+	}
+	registerStats("firmware", u.stats)
+	return u, nil
+}
+
+// registerFirmwareProgress is called once the SDK is initialized, the
+// updater itself is created before so the first attached devices see it.
+func registerFirmwareProgress() {
+	C.Jabra_RegisterFirmwareProgressCallBack((*[0]byte)(C.goFirmwareprogressfunc))
+}
+
+func (u *FirmwareUpdater) blobPath(hash string) string {
+	return filepath.Join(u.Dir, "sha256", hash)
+}
+
+// saveIndex rewrites the version index, u.lock must be held.
+func (u *FirmwareUpdater) saveIndex() error {
+	data, err := json.Marshal(u.index)
+	if err != nil {
+		return err
+	}
+	tmp := filepath.Join(u.Dir, "index.json.tmp")
+	if err := os.WriteFile(tmp, data, 0644); err != nil {
+		return err
+	}
+	return os.Rename(tmp, filepath.Join(u.Dir, "index.json"))
+}
+
+// Update brings a device to the latest firmware and blocks until it is
+// done, at most -firmware-parallel updates run at the same time.
+func (u *FirmwareUpdater) Update(device *DeviceInfo) error {
+	u.lock.Lock()
+	if p, ok := u.progress[device.SerialNumber]; ok && (p.Stage == "checking" || p.Stage == "downloading" || p.Stage == "queued" || p.Stage == "updating") {
+		u.lock.Unlock()
+		return errors.New("firmware update already running on " + device.DeviceName)
+	}
+	progress := &FirmwareProgress{DeviceName: device.DeviceName, Stage: "checking", Started: time.Now(), Updated: time.Now()}
+	u.progress[device.SerialNumber] = progress
+	u.lock.Unlock()
+
+	err := u.update(device, progress)
+	u.lock.Lock()
+	if err != nil {
+		progress.Stage, progress.Error = "failed", err.Error()
+	}
+	progress.Updated = time.Now()
+	u.lock.Unlock()
+	if err != nil {
+		log.Printf("firmware: update of %s failed: %v", device.DeviceName, err)
+	}
+	return err
+}
+
+func (u *FirmwareUpdater) setStage(progress *FirmwareProgress, stage string) {
+	u.lock.Lock()
+	progress.Stage, progress.Percentage, progress.Updated = stage, 0, time.Now()
+	progress.EstimatedCompletion = time.Time{}
+	u.lock.Unlock()
+}
+
+// scheduled records that an update of a device waits for an idle window.
+func (u *FirmwareUpdater) scheduled(device *DeviceInfo) {
+	u.lock.Lock()
+	defer u.lock.Unlock()
+	if p, ok := u.progress[device.SerialNumber]; ok && p.Stage != "updated" && p.Stage != "up to date" && p.Stage != "failed" && p.Stage != "locked" {
+		return
+	}
+	u.progress[device.SerialNumber] = &FirmwareProgress{DeviceName: device.DeviceName, Stage: "scheduled", Updated: time.Now()}
+}
+
+func (u *FirmwareUpdater) update(device *DeviceInfo, progress *FirmwareProgress) error {
+	id := C.ushort(device.DeviceID)
+	auth := C.CString(u.AuthorizationID)
+	defer C.free(unsafe.Pointer(auth))
+
+	var ret C.Jabra_ReturnCode
+	var version string
+	locked := false
+	if !backgroundWorker.Do(func() {
+		if locked = bool(C.Jabra_IsFirmwareLockEnabled(id)); locked {
+			return
+		}
+		if ret = C.Jabra_CheckForFirmwareUpdate(id, auth); ret != C.Firmware_Available {
+			return
+		}
+		if info := C.Jabra_GetLatestFirmwareInformation(id, auth); info != nil {
+			version = C.GoString(info.version)
+			C.Jabra_FreeFirmwareInfo(info)
+		}
+	}) {
+		return errors.New("device worker queue full")
+	}
+	switch {
+	case locked:
+		u.setStage(progress, "locked")
+		log.Printf("firmware: %s has the firmware lock enabled, not updating", device.DeviceName)
+		return nil
+	case ret == C.Firmware_UpToDate:
+		u.setStage(progress, "up to date")
+		return nil
+	case ret != C.Firmware_Available:
+		return fmt.Errorf("failed to check for firmware update: %d", int(ret))
+	case version == "":
+		return errors.New("failed to read latest firmware information")
+	}
+	u.lock.Lock()
+	progress.Version = version
+	u.lock.Unlock()
+
+	u.setStage(progress, "downloading")
+	path, err := u.resolve(device, version, progress)
+	if err != nil {
+		return err
+	}
+
+	u.setStage(progress, "queued")
+	u.slots <- struct{}{}
+
+	u.setStage(progress, "updating")
+	log.Printf("firmware: updating %s to %s", device.DeviceName, version)
+	job := u.listen(device.DeviceID, progress, true)
+	overdue := false
+	defer func() {
+		if !overdue {
+			u.unlisten(device.DeviceID, job)
+			<-u.slots
+		}
+	}()
+	cpath := C.CString(path)
+	defer C.free(unsafe.Pointer(cpath))
+	if !backgroundWorker.Do(func() { ret = C.Jabra_UpdateFirmware(id, cpath) }) {
+		return errors.New("device worker queue full")
+	}
+	if ret != C.Return_Ok && ret != C.Return_Async {
+		return fmt.Errorf("failed to start firmware update: %d", int(ret))
+	}
+	if ret == C.Return_Async {
+		status, ok := job.wait()
+		if !ok {
+			// the SDK may still be writing the image, its slot is only
+			// released once the update ends
+			overdue = true
+			go u.finish(device.DeviceID, job)
+			return errors.New("firmware update timed out")
+		}
+		if status != C.Completed {
+			return errors.New("firmware update " + firmwareStatusNames[status])
+		}
+	}
+	u.setStage(progress, "updated")
+	u.lock.Lock()
+	progress.Percentage = 100
+	u.lock.Unlock()
+	log.Printf("firmware: updated %s to %s", device.DeviceName, version)
+	return nil
+}
+
+// resolve returns the cached image of a version, downloading it once
+// however many devices of the product ask for it at the same time.
+func (u *FirmwareUpdater) resolve(device *DeviceInfo, version string, progress *FirmwareProgress) (string, error) {
+	key := fmt.Sprintf("%d/%s", device.ProductID, version)
+	u.lock.Lock()
+	if hash, ok := u.index[key]; ok {
+		if _, err := os.Stat(u.blobPath(hash)); err == nil {
+			u.lock.Unlock()
+			return u.blobPath(hash), nil
+		}
+		delete(u.index, key)
+	}
+	if download, ok := u.downloads[key]; ok {
+		u.lock.Unlock()
+		<-download.done
+		if download.err != nil {
+			return "", download.err
+		}
+		return u.blobPath(download.hash), nil
+	}
+	download := &firmwareDownload{done: make(chan struct{})}
+	u.downloads[key] = download
+	u.lock.Unlock()
+
+	download.hash, download.err = u.download(device, version, progress)
+	u.lock.Lock()
+	delete(u.downloads, key)
+	if download.err == nil {
+		u.index[key] = download.hash
+		if err := u.saveIndex(); err != nil {
+			log.Println("firmware:", err)
+		}
+	}
+	u.lock.Unlock()
+	close(download.done)
+	if download.err != nil {
+		return "", download.err
+	}
+	return u.blobPath(download.hash), nil
+}
+
+// download fetches an image through the SDK and moves it into the cache.
+func (u *FirmwareUpdater) download(device *DeviceInfo, version string, progress *FirmwareProgress) (string, error) {
+	id := C.ushort(device.DeviceID)
+	cversion := C.CString(version)
+	defer C.free(unsafe.Pointer(cversion))
+	auth := C.CString(u.AuthorizationID)
+	defer C.free(unsafe.Pointer(auth))
+
+	log.Printf("firmware: downloading %s for product %d", version, device.ProductID)
+	job := u.listen(device.DeviceID, progress, false)
+	defer u.unlisten(device.DeviceID, job)
+	var ret C.Jabra_ReturnCode
+	if !backgroundWorker.Do(func() { ret = C.Jabra_DownloadFirmware(id, cversion, auth) }) {
+		return "", errors.New("device worker queue full")
+	}
+	if ret != C.Return_Ok && ret != C.Return_Async {
+		return "", fmt.Errorf("failed to start firmware download: %d", int(ret))
+	}
+	if ret == C.Return_Async {
+		if status, _ := job.wait(); status != C.Completed && status != C.File_AlreadyPresent {
+			return "", errors.New("firmware download " + firmwareStatusNames[status])
+		}
+	}
+
+	var path string
+	backgroundWorker.Do(func() {
+		if cpath := C.Jabra_GetFirmwareFilePath(id, cversion); cpath != nil {
+			path = C.GoString(cpath)
+			C.Jabra_FreeString(cpath)
+		}
+	})
+	if path == "" {
+		return "", errors.New("no firmware file for version " + version)
+	}
+	return u.store(path)
+}
+
+// store copies a file into the cache under its SHA-256.
+func (u *FirmwareUpdater) store(path string) (string, error) {
+	in, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer in.Close()
+	tmp, err := os.CreateTemp(filepath.Join(u.Dir, "sha256"), ".download-*")
+	if err != nil {
+		return "", err
+	}
+	defer os.Remove(tmp.Name())
+	hash := sha256.New()
+	if _, err := io.Copy(io.MultiWriter(tmp, hash), in); err != nil {
+		tmp.Close()
+		return "", err
+	}
+	if err := tmp.Close(); err != nil {
+		return "", err
+	}
+	sum := hex.EncodeToString(hash.Sum(nil))
+	return sum, os.Rename(tmp.Name(), u.blobPath(sum))
+}
+
+func (u *FirmwareUpdater) listen(deviceID uint16, progress *FirmwareProgress, update bool) *firmwareJob {
+	job := &firmwareJob{progress: progress, update: update, started: time.Now(), done: make(chan int, 1), removed: make(chan struct{})}
+	u.lock.Lock()
+	u.active[deviceID] = job
+	u.lock.Unlock()
+	return job
+}
+
+func (u *FirmwareUpdater) unlisten(deviceID uint16, job *firmwareJob) {
+	u.lock.Lock()
+	if u.active[deviceID] == job {
+		delete(u.active, deviceID)
+	}
+	u.lock.Unlock()
+}
+
+// wait returns the terminal status of a job, or Cancelled and false once
+// firmwareTimeout has passed.
+func (job *firmwareJob) wait() (int, bool) {
+	select {
+	case status := <-job.done:
+		return status, true
+	case <-time.After(firmwareTimeout):
+		return C.Cancelled, false
+	}
+}
+
+// finish releases the slot of an update that outlived firmwareTimeout once
+// the progress callback reports its end or the device is removed.
+func (u *FirmwareUpdater) finish(deviceID uint16, job *firmwareJob) {
+	select {
+	case status := <-job.done:
+		log.Printf("firmware: overdue update of %s ended: %s", job.progress.DeviceName, firmwareStatusNames[status])
+	case <-job.removed:
+	}
+	u.unlisten(deviceID, job)
+	<-u.slots
+}
+
+// Remove ends the wait for an overdue update of a removed device.
+func (u *FirmwareUpdater) Remove(device *DeviceInfo) {
+	if u == nil {
+		return
+	}
+	u.lock.Lock()
+	defer u.lock.Unlock()
+	if job, ok := u.active[device.DeviceID]; ok && !job.gone {
+		job.gone = true
+		close(job.removed)
+	}
+}
+
+//export goFirmwareprogressfunc
+func goFirmwareprogressfunc(deviceid uint16, eventType C.Jabra_FirmwareEventType, status C.Jabra_FirmwareEventStatus, percentage uint16) {
+	if firmware == nil {
+		return
+	}
+	firmware.lock.Lock()
+	defer firmware.lock.Unlock()
+	job, ok := firmware.active[deviceid]
+	if !ok || job.update != (eventType == C.Firmware_Update) {
+		return
+	}
+	now := time.Now()
+	job.progress.Percentage = int(percentage)
+	job.progress.Updated = now
+	if percentage > 0 && percentage < 100 {
+		elapsed := now.Sub(job.started)
+		job.progress.EstimatedCompletion = now.Add(elapsed * time.Duration(100-percentage) / time.Duration(percentage))
+	}
+	if status != C.Initiating && status != C.InProgress {
+		select {
+		case job.done <- int(status):
+		default:
+		}
+	}
+}
+
+func (u *FirmwareUpdater) stats() interface{} {
+	u.lock.Lock()
+	defer u.lock.Unlock()
+	stats := make(map[string]FirmwareProgress, len(u.progress))
+	for serialNumber, progress := range u.progress {
+		stats[serialNumber] = *progress
+	}
+	return stats
+}
+
+// serveFirmwareUpdate schedules the update of the device given by ?serial=,
+// or of every attached device but dongles, for the next idle window, or
+// starts it right away with ?now=1. Progress is in /stats/firmware.
+func serveFirmwareUpdate(w http.ResponseWriter, r *http.Request) {
+	if firmware == nil {
+		http.Error(w, "no firmware cache", http.StatusNotFound)
+		return
+	}
+	if r.Method != http.MethodPost {
+		http.Error(w, "POST to start firmware updates", http.StatusMethodNotAllowed)
+		return
+	}
+	var devices []*DeviceInfo
+	if serial := r.URL.Query().Get("serial"); serial != "" {
+		device := findDevice(serial)
+		if device == nil {
+			http.Error(w, "no attached device "+serial, http.StatusNotFound)
+			return
+		}
+		devices = append(devices, device)
+	} else {
+		deviceListLock.Lock()
+		for _, device := range deviceList {
+			if !device.IsDongle {
+				devices = append(devices, device)
+			}
+		}
+		deviceListLock.Unlock()
+	}
+	now := r.URL.Query().Get("now") == "1"
+	serials := make([]string, 0, len(devices))
+	for _, device := range devices {
+		serials = append(serials, device.SerialNumber)
+		if now {
+			go firmware.Update(device)
+		} else {
+			firmwareScheduler.Schedule(device)
+		}
+	}
+	writeJSON(w, serials)
+}
+
+func init() {
+	registerControl("/firmware/update", serveFirmwareUpdate)
+}
@@ -0,0 +1,117 @@
+package main
+
+import (
+	"log"
+	"math/rand"
+	"sync"
+	"time"
+)
+
+// FirmwareScheduler starts the firmware updates of attached devices only
+// once the user has been idle (busy light off, not off hook) for IdleWindow,
+// one at a time spaced by a random delay between Jitter/2 and Jitter, so
+// updates that piled up are spread instead of all starting at login.
+type FirmwareScheduler struct {
+	IdleWindow time.Duration
+	Jitter     time.Duration
+	OnAttach   bool // schedule every device when it is attached
+	lock       sync.Mutex
+	queue      []string // serial numbers, in scheduling order
+	queued     map[string]bool
+	next       time.Time // earliest start of the next update
+	wake       chan struct{}
+}
+
+// firmwareScheduler is nil unless the daemon was started with -firmware-cache.
+var firmwareScheduler *FirmwareScheduler
+
+func NewFirmwareScheduler(idleWindow time.Duration, jitter time.Duration) *FirmwareScheduler {
+	return &FirmwareScheduler{
+		IdleWindow: idleWindow,
+		Jitter:     jitter,
+		queued:     make(map[string]bool),
+		wake:       make(chan struct{}, 1),
+	}
+}
+
+func (s *FirmwareScheduler) jitter() time.Duration {
+	if s.Jitter <= 0 {
+		return 0
+	}
+	return time.Duration(rand.Int63n(int64(s.Jitter)))
+}
+
+func (s *FirmwareScheduler) Attached(device *DeviceInfo) {
+	if s != nil && s.OnAttach {
+		s.Schedule(device)
+	}
+}
+
+// Schedule queues the update of a device for the next idle window.
+func (s *FirmwareScheduler) Schedule(device *DeviceInfo) {
+	if s == nil || device.IsDongle || device.SerialNumber == "" {
+		return
+	}
+	s.lock.Lock()
+	if s.queued[device.SerialNumber] {
+		s.lock.Unlock()
+		return
+	}
+	if len(s.queue) == 0 {
+		s.next = time.Now().Add(s.jitter())
+	}
+	s.queue = append(s.queue, device.SerialNumber)
+	s.queued[device.SerialNumber] = true
+	s.lock.Unlock()
+	firmware.scheduled(device)
+	select {
+	case s.wake <- struct{}{}:
+	default:
+	}
+}
+
+func (s *FirmwareScheduler) Run() {
+	timer := time.NewTimer(s.IdleWindow)
+	for {
+		select {
+		case <-timer.C:
+		case <-s.wake:
+		}
+		timer.Stop()
+		timer.Reset(s.step(time.Now()))
+	}
+}
+
+// step starts the next update if the user is idle and returns when to check again.
+func (s *FirmwareScheduler) step(now time.Time) time.Duration {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	if len(s.queue) == 0 {
+		return time.Hour
+	}
+	busy, since := busyState()
+	if busy {
+		// the end of the busy state is not signalled, poll for it
+		return time.Minute
+	}
+	if idle := now.Sub(since); idle < s.IdleWindow {
+		return s.IdleWindow - idle
+	}
+	if now.Before(s.next) {
+		return s.next.Sub(now)
+	}
+
+	serialNumber := s.queue[0]
+	s.queue = s.queue[1:]
+	delete(s.queued, serialNumber)
+	if device := findDevice(serialNumber); device != nil {
+		go firmware.Update(device)
+	} else {
+		log.Printf("firmware: %s is not attached anymore, update dropped", serialNumber)
+	}
+	s.next = now.Add(s.Jitter/2 + s.jitter()/2)
+	if len(s.queue) == 0 {
+		return time.Hour
+	}
+	return s.next.Sub(now)
+}
@@ -0,0 +1,285 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Video.h"
+*/
+import "C"
+import (
+	"encoding/json"
+	"fmt"
+	"log"
+	"net/http"
+	"sync"
+	"time"
+)
+
+// imageQualityMaxAge is how long cached image controls are trusted, the
+// camera's own controls or another application may change them.
+const imageQualityMaxAge = 30 * time.Second
+
+type ImageQuality struct {
+	Contrast         int
+	Sharpness        int
+	Brightness       int
+	Saturation       int
+	WhiteBalance     int
+	AutoWhiteBalance bool
+}
+
+type ImageQualityLimits struct {
+	Contrast     CameraLimit
+	Sharpness    CameraLimit
+	Brightness   CameraLimit
+	Saturation   CameraLimit
+	WhiteBalance CameraLimit
+}
+
+// ImageQualityProfile holds the controls to apply, nil ones are left as they are.
+type ImageQualityProfile struct {
+	Contrast         *int  `json:",omitempty"`
+	Sharpness        *int  `json:",omitempty"`
+	Brightness       *int  `json:",omitempty"`
+	Saturation       *int  `json:",omitempty"`
+	WhiteBalance     *int  `json:",omitempty"`
+	AutoWhiteBalance *bool `json:",omitempty"`
+}
+
+// imageQualityCamera caches the image controls of a camera. Limits are read
+// once, they never change, values are read again once older than
+// imageQualityMaxAge and after a failed write, so reads and unchanged
+// controls mostly cost no HID transaction.
+type imageQualityCamera struct {
+	device *DeviceInfo
+	lock   sync.Mutex // serializes writes
+	limits ImageQualityLimits
+	values ImageQuality
+	read   time.Time // when values were read
+}
+
+var imageQualityCameras = make(map[uint16]*imageQualityCamera, 0)
+var imageQualityLock = sync.Mutex{}
+
+func openImageQuality(device *DeviceInfo) (*imageQualityCamera, error) {
+	imageQualityLock.Lock()
+	camera, ok := imageQualityCameras[device.DeviceID]
+	imageQualityLock.Unlock()
+	if ok {
+		return camera, nil
+	}
+
+	id := C.ushort(device.DeviceID)
+	var err error
+	read := func(name string, ret C.Jabra_ReturnCode) {
+		if ret != C.Return_Ok && err == nil {
+			err = fmt.Errorf("failed to read %s of %s: %d", name, device.DeviceName, int(ret))
+		}
+	}
+	var limits [5][3]C.int // min, max and step of each control
+	read("contrast limits", C.Jabra_GetContrastLimits(id, &limits[0][0], &limits[0][1], &limits[0][2]))
+	read("sharpness limits", C.Jabra_GetSharpnessLimits(id, &limits[1][0], &limits[1][1]))
+	read("brightness limits", C.Jabra_GetBrightnessLimits(id, &limits[2][0], &limits[2][1], &limits[2][2]))
+	read("saturation limits", C.Jabra_GetSaturationLimits(id, &limits[3][0], &limits[3][1]))
+	read("white balance limits", C.Jabra_GetWhiteBalanceLimits(id, &limits[4][0], &limits[4][1]))
+	if err != nil {
+		return nil, err
+	}
+	limit := func(i int) CameraLimit {
+		step := int32(limits[i][2])
+		if step == 0 {
+			step = 1
+		}
+		return CameraLimit{Min: int32(limits[i][0]), Max: int32(limits[i][1]), Step: step}
+	}
+	camera = &imageQualityCamera{
+		device: device,
+		limits: ImageQualityLimits{Contrast: limit(0), Sharpness: limit(1), Brightness: limit(2), Saturation: limit(3), WhiteBalance: limit(4)},
+	}
+	if err := camera.readValues(); err != nil {
+		return nil, err
+	}
+
+	imageQualityLock.Lock()
+	defer imageQualityLock.Unlock()
+	if known, ok := imageQualityCameras[device.DeviceID]; ok {
+		return known, nil
+	}
+	imageQualityCameras[device.DeviceID] = camera
+	return camera, nil
+}
+
+func removeImageQuality(device *DeviceInfo) {
+	imageQualityLock.Lock()
+	defer imageQualityLock.Unlock()
+	delete(imageQualityCameras, device.DeviceID)
+}
+
+// readValues reads the image controls of the camera into the cache,
+// camera.lock must be held once the camera is shared.
+func (camera *imageQualityCamera) readValues() error {
+	id := C.ushort(camera.device.DeviceID)
+	var err error
+	read := func(name string, ret C.Jabra_ReturnCode) {
+		if ret != C.Return_Ok && err == nil {
+			err = fmt.Errorf("failed to read %s of %s: %d", name, camera.device.DeviceName, int(ret))
+		}
+	}
+	var contrast, sharpness, brightness, saturation, whiteBalance C.int
+	var autoWhiteBalance C.Jabra_AutoWhiteBalance
+	read("contrast", C.Jabra_GetContrastLevel(id, &contrast))
+	read("sharpness", C.Jabra_GetSharpnessLevel(id, &sharpness))
+	read("brightness", C.Jabra_GetBrightnessLevel(id, &brightness))
+	read("saturation", C.Jabra_GetSaturationLevel(id, &saturation))
+	read("white balance", C.Jabra_GetWhiteBalance(id, &whiteBalance, &autoWhiteBalance))
+	if err != nil {
+		return err
+	}
+	camera.values = ImageQuality{
+		Contrast:         int(contrast),
+		Sharpness:        int(sharpness),
+		Brightness:       int(brightness),
+		Saturation:       int(saturation),
+		WhiteBalance:     int(whiteBalance),
+		AutoWhiteBalance: autoWhiteBalance == C.AUTO_ADJUSTMENT,
+	}
+	camera.read = time.Now()
+	return nil
+}
+
+// refresh reads the values again once they are older than
+// imageQualityMaxAge, camera.lock must be held. The cache is kept if the
+// read fails.
+func (camera *imageQualityCamera) refresh() {
+	if time.Since(camera.read) < imageQualityMaxAge {
+		return
+	}
+	if err := camera.readValues(); err != nil {
+		log.Println("imagequality:", err)
+	}
+}
+
+func (camera *imageQualityCamera) Values() ImageQuality {
+	camera.lock.Lock()
+	defer camera.lock.Unlock()
+	camera.refresh()
+	return camera.values
+}
+
+// ApplyImageQuality writes the controls of a profile that differ from the
+// cache, after checking them all against the limits, and returns the names
+// of the controls written.
+func ApplyImageQuality(device *DeviceInfo, profile ImageQualityProfile) ([]string, error) {
+	camera, err := openImageQuality(device)
+	if err != nil {
+		return nil, err
+	}
+	camera.lock.Lock()
+	defer camera.lock.Unlock()
+	camera.refresh()
+
+	id := C.ushort(device.DeviceID)
+	values := &camera.values
+	controls := []struct {
+		name    string
+		desired *int
+		current *int
+		limit   CameraLimit
+		write   func(value int) C.Jabra_ReturnCode
+	}{
+		{"Contrast", profile.Contrast, &values.Contrast, camera.limits.Contrast, func(value int) C.Jabra_ReturnCode {
+			return C.Jabra_SetContrastLevel(id, C.int(value))
+		}},
+		{"Sharpness", profile.Sharpness, &values.Sharpness, camera.limits.Sharpness, func(value int) C.Jabra_ReturnCode {
+			return C.Jabra_SetSharpnessLevel(id, C.int(value))
+		}},
+		{"Brightness", profile.Brightness, &values.Brightness, camera.limits.Brightness, func(value int) C.Jabra_ReturnCode {
+			return C.Jabra_SetBrightnessLevel(id, C.int(value))
+		}},
+		{"Saturation", profile.Saturation, &values.Saturation, camera.limits.Saturation, func(value int) C.Jabra_ReturnCode {
+			return C.Jabra_SetSaturationLevel(id, C.int(value))
+		}},
+	}
+	for _, control := range controls {
+		if control.desired != nil && int64(*control.desired) != control.limit.clamp(int64(*control.desired)) {
+			return nil, fmt.Errorf("%s %d out of range [%d, %d]", control.name, *control.desired, control.limit.Min, control.limit.Max)
+		}
+	}
+	whiteBalance, autoWhiteBalance := values.WhiteBalance, values.AutoWhiteBalance
+	if profile.WhiteBalance != nil {
+		whiteBalance = *profile.WhiteBalance
+		if int64(whiteBalance) != camera.limits.WhiteBalance.clamp(int64(whiteBalance)) {
+			return nil, fmt.Errorf("WhiteBalance %d out of range [%d, %d]", whiteBalance, camera.limits.WhiteBalance.Min, camera.limits.WhiteBalance.Max)
+		}
+	}
+	if profile.AutoWhiteBalance != nil {
+		autoWhiteBalance = *profile.AutoWhiteBalance
+	}
+
+	var written []string
+	for _, control := range controls {
+		if control.desired == nil || *control.desired == *control.current {
+			continue
+		}
+		if ret := control.write(*control.desired); ret != C.Return_Ok {
+			// the camera may have kept or clamped the value
+			camera.read = time.Time{}
+			camera.refresh()
+			return written, fmt.Errorf("failed to write %s on %s: %d", control.name, device.DeviceName, int(ret))
+		}
+		*control.current = *control.desired
+		written = append(written, control.name)
+	}
+	if whiteBalance != values.WhiteBalance || autoWhiteBalance != values.AutoWhiteBalance {
+		mode := C.Jabra_AutoWhiteBalance(C.USE_WB_TEMP_VALUE)
+		if autoWhiteBalance {
+			mode = C.AUTO_ADJUSTMENT
+		}
+		if ret := C.Jabra_SetWhiteBalance(id, C.int(whiteBalance), mode); ret != C.Return_Ok {
+			// the camera may have kept or clamped the value
+			camera.read = time.Time{}
+			camera.refresh()
+			return written, fmt.Errorf("failed to write WhiteBalance on %s: %d", device.DeviceName, int(ret))
+		}
+		values.WhiteBalance, values.AutoWhiteBalance = whiteBalance, autoWhiteBalance
+		written = append(written, "WhiteBalance")
+	}
+	return written, nil
+}
+
+// serveImageQuality returns the image controls and limits of the camera
+// given by ?serial=, posting a JSON profile applies it.
+func serveImageQuality(w http.ResponseWriter, r *http.Request) {
+	device := findDevice(r.URL.Query().Get("serial"))
+	if device == nil {
+		http.Error(w, "no attached device "+r.URL.Query().Get("serial"), http.StatusNotFound)
+		return
+	}
+	if r.Method == http.MethodPost {
+		var profile ImageQualityProfile
+		if err := json.NewDecoder(r.Body).Decode(&profile); err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		written, err := ApplyImageQuality(device, profile)
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		writeJSON(w, struct{ Written []string }{written})
+		return
+	}
+	camera, err := openImageQuality(device)
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusNotImplemented)
+		return
+	}
+	writeJSON(w, struct {
+		Values ImageQuality
+		Limits ImageQualityLimits
+	}{camera.Values(), camera.limits})
+}
+
+func init() {
+	registerControl("/imagequality", serveImageQuality)
+}
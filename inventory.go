@@ -0,0 +1,328 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Firmware.h"
+#include "jabra/JabraDeviceConfig.h"
+*/
+import "C"
+import (
+	"bufio"
+	"encoding/csv"
+	"encoding/json"
+	"errors"
+	"io"
+	"log"
+	"net/http"
+	"os"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+var systemComponentNames = map[int]string{
+	C.PRIMARY_HEADSET: "primary", C.SECONDARY_HEADSET: "secondary", C.CRADLE: "cradle", C.OTHER: "other",
+}
+
+// InventoryRecord describes a device that has been attached at least once.
+// Everything but the firmware versions and LastSeen is static for a serial
+// number and only read from the device the first time it is seen.
+type InventoryRecord struct {
+	SerialNumber         string
+	ProductID            uint16
+	DeviceName           string
+	ESN                  map[string]string `json:",omitempty"`
+	SKU                  string            `json:",omitempty"`
+	HardwareVersion      uint16
+	ConfigVersion        uint16
+	WarrantyEndDate      string `json:",omitempty"`
+	FirmwareVersion      string
+	FirmwareVersionChild string `json:",omitempty"`
+	FirstSeen            time.Time
+	LastSeen             time.Time
+}
+
+var inventoryColumns = []string{"serial", "product_id", "name", "esn", "sku", "hardware_version", "config_version",
+	"warranty_end_date", "firmware_version", "firmware_version_child", "first_seen", "last_seen"}
+
+func (r *InventoryRecord) columns() []string {
+	var esn []string
+	for component, value := range r.ESN {
+		esn = append(esn, component+"="+value)
+	}
+	sort.Strings(esn)
+	return []string{r.SerialNumber, strconv.Itoa(int(r.ProductID)), r.DeviceName, strings.Join(esn, ";"), r.SKU,
+		strconv.Itoa(int(r.HardwareVersion)), strconv.Itoa(int(r.ConfigVersion)), r.WarrantyEndDate,
+		r.FirmwareVersion, r.FirmwareVersionChild, r.FirstSeen.Format(time.RFC3339), r.LastSeen.Format(time.RFC3339)}
+}
+
+// the inventory file is compacted once it holds this many lines more than records
+const inventoryCompactSlack = 256
+
+// Inventory keeps every device ever attached in memory and in a JSON lines
+// file, where the last line of a serial number wins.
+type Inventory struct {
+	Path    string
+	lock    sync.Mutex
+	records map[string]*InventoryRecord
+	lines   int // in the file
+}
+
+// inventory is nil unless the daemon was started with -inventory.
+var inventory *Inventory
+
+// LoadInventory reads the inventory file and compacts it, for the daemon
+// that appends to it.
+func LoadInventory(path string) (*Inventory, error) {
+	inv, err := ReadInventory(path)
+	if err != nil {
+		return nil, err
+	}
+	if inv.lines > len(inv.records) {
+		if err := inv.compact(); err != nil {
+			log.Println("inventory:", err)
+		}
+	}
+	return inv, nil
+}
+
+// ReadInventory reads the inventory file without ever writing it, it is
+// safe while a running daemon appends to the file.
+func ReadInventory(path string) (*Inventory, error) {
+	inv := &Inventory{Path: path, records: make(map[string]*InventoryRecord)}
+	file, err := os.Open(path)
+	if os.IsNotExist(err) {
+		return inv, nil
+	}
+	if err != nil {
+		return nil, err
+	}
+	defer file.Close()
+	scanner := bufio.NewScanner(file)
+	scanner.Buffer(make([]byte, 64*1024), 1024*1024)
+	for scanner.Scan() {
+		inv.lines++
+		var record InventoryRecord
+		if err := json.Unmarshal(scanner.Bytes(), &record); err != nil {
+			log.Println("inventory:", err)
+			continue
+		}
+		inv.records[record.SerialNumber] = &record
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, err
+	}
+	return inv, nil
+}
+
+// compact rewrites the inventory file with a single line per serial number,
+// inv.lock must be held once the inventory is shared.
+func (inv *Inventory) compact() error {
+	tmp := inv.Path + ".tmp"
+	file, err := os.Create(tmp)
+	if err != nil {
+		return err
+	}
+	out := bufio.NewWriter(file)
+	encoder := json.NewEncoder(out)
+	for _, record := range inv.records {
+		encoder.Encode(record)
+	}
+	if err := out.Flush(); err != nil {
+		file.Close()
+		return err
+	}
+	if err := file.Close(); err != nil {
+		return err
+	}
+	if err := os.Rename(tmp, inv.Path); err != nil {
+		return err
+	}
+	inv.lines = len(inv.records)
+	return nil
+}
+
+// Refresh updates the record of an attached device on the background worker.
+func (inv *Inventory) Refresh(device *DeviceInfo) {
+	if inv == nil || device.SerialNumber == "" {
+		return
+	}
+	backgroundWorker.Submit(func() { inv.refresh(device) })
+}
+
+func (inv *Inventory) refresh(device *DeviceInfo) {
+	inv.lock.Lock()
+	known, ok := inv.records[device.SerialNumber]
+	var record InventoryRecord
+	if ok {
+		record = *known
+	}
+	inv.lock.Unlock()
+
+	id := C.ushort(device.DeviceID)
+	if !ok {
+		record = InventoryRecord{SerialNumber: device.SerialNumber, ProductID: device.ProductID, FirstSeen: time.Now()}
+		record.ESN = readMultiESN(id)
+		record.SKU = readSDKString(func(buf *C.char, count C.int) C.Jabra_ReturnCode {
+			return C.Jabra_GetSku(id, buf, C.uint(count))
+		})
+		var hw, config C.ushort
+		if C.Jabra_GetHwAndConfigVersion(id, &hw, &config) == C.Return_Ok {
+			record.HardwareVersion, record.ConfigVersion = uint16(hw), uint16(config)
+		}
+		if warranty := C.Jabra_GetWarrantyEndDate(id); warranty != nil {
+			record.WarrantyEndDate = C.GoString(warranty)
+			C.Jabra_FreeString(warranty)
+		}
+	}
+	record.DeviceName = device.DeviceName
+	record.LastSeen = time.Now()
+	// the bundle holds both versions, devices without one only have their own
+	parent := make([]byte, 64)
+	child := make([]byte, 64)
+	if C.Jabra_GetFirmwareVersionBundle(id, (*C.char)(unsafe.Pointer(&parent[0])), (*C.char)(unsafe.Pointer(&child[0])), C.int(len(parent))) == C.Return_Ok {
+		record.FirmwareVersion = C.GoString((*C.char)(unsafe.Pointer(&parent[0])))
+		record.FirmwareVersionChild = C.GoString((*C.char)(unsafe.Pointer(&child[0])))
+	}
+	if record.FirmwareVersion == "" {
+		record.FirmwareVersion = readSDKString(func(buf *C.char, count C.int) C.Jabra_ReturnCode {
+			return C.Jabra_GetFirmwareVersion(id, buf, count)
+		})
+	}
+
+	inv.lock.Lock()
+	defer inv.lock.Unlock()
+	inv.records[record.SerialNumber] = &record
+	if err := inv.append(&record); err != nil {
+		log.Println("inventory:", err)
+		return
+	}
+	inv.lines++
+	if inv.lines > len(inv.records)+inventoryCompactSlack {
+		if err := inv.compact(); err != nil {
+			log.Println("inventory:", err)
+		}
+	}
+}
+
+// append writes a record to the inventory file, inv.lock must be held.
+func (inv *Inventory) append(record *InventoryRecord) error {
+	file, err := os.OpenFile(inv.Path, os.O_WRONLY|os.O_APPEND|os.O_CREATE, 0644)
+	if err != nil {
+		return err
+	}
+	defer file.Close()
+	return json.NewEncoder(file).Encode(record)
+}
+
+// readSDKString reads a string through an SDK call writing into a caller allocated buffer.
+func readSDKString(read func(buf *C.char, count C.int) C.Jabra_ReturnCode) string {
+	buf := make([]byte, 64)
+	if read((*C.char)(unsafe.Pointer(&buf[0])), C.int(len(buf))) != C.Return_Ok {
+		return ""
+	}
+	return C.GoString((*C.char)(unsafe.Pointer(&buf[0])))
+}
+
+func readMultiESN(id C.ushort) map[string]string {
+	esn := C.Jabra_GetMultiESN(id)
+	if esn == nil {
+		return nil
+	}
+	defer C.Jabra_FreeMap(esn)
+	values := make(map[string]string, int(esn.length))
+	for _, entry := range unsafe.Slice(esn.entries, int(esn.length)) {
+		name, ok := systemComponentNames[int(entry.key)]
+		if !ok {
+			name = strconv.Itoa(int(entry.key))
+		}
+		values[name] = C.GoString(entry.value)
+	}
+	return values
+}
+
+// Export streams the inventory as "json" (one array) or "csv", record by record.
+func (inv *Inventory) Export(w io.Writer, format string) error {
+	inv.lock.Lock()
+	serials := make([]string, 0, len(inv.records))
+	for serial := range inv.records {
+		serials = append(serials, serial)
+	}
+	inv.lock.Unlock()
+	sort.Strings(serials)
+
+	next := func(i int) (InventoryRecord, bool) {
+		inv.lock.Lock()
+		defer inv.lock.Unlock()
+		record, ok := inv.records[serials[i]]
+		if !ok {
+			return InventoryRecord{}, false
+		}
+		return *record, true
+	}
+
+	out := bufio.NewWriter(w)
+	switch format {
+	case "csv":
+		writer := csv.NewWriter(out)
+		writer.Write(inventoryColumns)
+		for i := range serials {
+			if record, ok := next(i); ok {
+				writer.Write(record.columns())
+			}
+		}
+		writer.Flush()
+		if err := writer.Error(); err != nil {
+			return err
+		}
+	case "json":
+		encoder := json.NewEncoder(out)
+		out.WriteString("[")
+		first := true
+		for i := range serials {
+			record, ok := next(i)
+			if !ok {
+				continue
+			}
+			if !first {
+				out.WriteString(",")
+			}
+			first = false
+			if err := encoder.Encode(&record); err != nil {
+				return err
+			}
+		}
+		out.WriteString("]\n")
+	default:
+		return errors.New("unknown inventory format " + format)
+	}
+	return out.Flush()
+}
+
+// serveInventory exports the inventory as ?format=json (default) or csv.
+func serveInventory(w http.ResponseWriter, r *http.Request) {
+	if inventory == nil {
+		http.Error(w, "no inventory file", http.StatusNotFound)
+		return
+	}
+	format := r.URL.Query().Get("format")
+	if format == "" {
+		format = "json"
+	}
+	if format == "csv" {
+		w.Header().Set("Content-Type", "text/csv")
+	} else {
+		w.Header().Set("Content-Type", "application/json")
+	}
+	if err := inventory.Export(w, format); err != nil {
+		log.Println("inventory:", err)
+	}
+}
+
+func init() {
+	statsMux.HandleFunc("/inventory", serveInventory)
+}
@@ -0,0 +1,157 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Bluetooth.h"
+extern void goLinkqualityfunc(unsigned short deviceID, LinkQuality status);
+*/
+import "C"
+import (
+	"strconv"
+	"sync/atomic"
+	"time"
+)
+
+const linkQualityLevels = 3 // LINKQUALITY_OFF, LINKQUALITY_LOW, LINKQUALITY_HIGH
+
+var linkQualityNames = [linkQualityLevels]string{"off", "low", "high"}
+
+// linkQualitySlot holds the counters of one device. Slots are preallocated
+// and only updated with atomics, so the listener neither locks nor allocates
+// unless telemetry is enabled, where it records each change of quality.
+type linkQualitySlot struct {
+	device      uint32 // deviceID + 1, 0 when the slot is free
+	last        uint32 // last quality + 1, 0 before the first event
+	since       int64  // unix nanoseconds of the last event
+	events      [linkQualityLevels]uint64
+	durations   [linkQualityLevels]uint64 // nanoseconds spent in each quality
+	transitions [linkQualityLevels][linkQualityLevels]uint64
+}
+
+var linkQualitySlots [64]linkQualitySlot
+
+func registerLinkQuality() {
+	registerStats("linkquality", linkQualityStats)
+}
+
+func findLinkQualitySlot(deviceID uint16) *linkQualitySlot {
+	for i := range linkQualitySlots {
+		if atomic.LoadUint32(&linkQualitySlots[i].device) == uint32(deviceID)+1 {
+			return &linkQualitySlots[i]
+		}
+	}
+	return nil
+}
+
+func watchLinkQuality(device *DeviceInfo) {
+	if findLinkQualitySlot(device.DeviceID) != nil {
+		return
+	}
+	for i := range linkQualitySlots {
+		slot := &linkQualitySlots[i]
+		if atomic.LoadUint32(&slot.device) != 0 {
+			continue
+		}
+		atomic.StoreUint32(&slot.last, 0)
+		atomic.StoreInt64(&slot.since, 0)
+		for q := 0; q < linkQualityLevels; q++ {
+			atomic.StoreUint64(&slot.events[q], 0)
+			atomic.StoreUint64(&slot.durations[q], 0)
+			for r := 0; r < linkQualityLevels; r++ {
+				atomic.StoreUint64(&slot.transitions[q][r], 0)
+			}
+		}
+		if !atomic.CompareAndSwapUint32(&slot.device, 0, uint32(device.DeviceID)+1) {
+			continue
+		}
+		ret := C.Jabra_SetLinkQualityStatusListener(C.ushort(device.DeviceID), (*[0]byte)(C.goLinkqualityfunc))
+		if ret != C.Return_Ok {
+			atomic.StoreUint32(&slot.device, 0)
+		}
+		return
+	}
+}
+
+func unwatchLinkQuality(device *DeviceInfo) {
+	if slot := findLinkQualitySlot(device.DeviceID); slot != nil {
+		atomic.StoreUint32(&slot.device, 0)
+	}
+}
+
+//export goLinkqualityfunc
+func goLinkqualityfunc(deviceid uint16, status C.LinkQuality) {
+	slot := findLinkQualitySlot(deviceid)
+	quality := uint32(status)
+	if slot == nil || quality >= linkQualityLevels {
+		return
+	}
+	now := time.Now().UnixNano()
+	atomic.AddUint64(&slot.events[quality], 1)
+	previous := atomic.SwapUint32(&slot.last, quality+1)
+	since := atomic.SwapInt64(&slot.since, now)
+	if telemetry != nil && previous != quality+1 {
+		deviceListLock.Lock()
+		device, ok := deviceList[deviceid]
+		deviceListLock.Unlock()
+		if ok {
+			telemetry.Append(device.SerialNumber, TelemetryLinkQuality, int64(quality))
+		}
+	}
+	if previous == 0 {
+		return
+	}
+	atomic.AddUint64(&slot.durations[previous-1], uint64(now-since))
+	if previous-1 != quality {
+		atomic.AddUint64(&slot.transitions[previous-1][quality], 1)
+	}
+}
+
+type LinkQualityStats struct {
+	Device      string
+	Quality     string
+	Events      map[string]uint64
+	Durations   map[string]string
+	Transitions map[string]uint64
+}
+
+func linkQualityStats() interface{} {
+	now := time.Now().UnixNano()
+	stats := make(map[string]LinkQualityStats, 0)
+	for i := range linkQualitySlots {
+		slot := &linkQualitySlots[i]
+		device := atomic.LoadUint32(&slot.device)
+		if device == 0 {
+			continue
+		}
+		deviceID := uint16(device - 1)
+		s := LinkQualityStats{
+			Events:      make(map[string]uint64, linkQualityLevels),
+			Durations:   make(map[string]string, linkQualityLevels),
+			Transitions: make(map[string]uint64, 0),
+		}
+		deviceListLock.Lock()
+		if d, ok := deviceList[deviceID]; ok {
+			s.Device = d.DeviceName
+		}
+		deviceListLock.Unlock()
+
+		last := atomic.LoadUint32(&slot.last)
+		for q := 0; q < linkQualityLevels; q++ {
+			s.Events[linkQualityNames[q]] = atomic.LoadUint64(&slot.events[q])
+			duration := atomic.LoadUint64(&slot.durations[q])
+			if last == uint32(q)+1 {
+				duration += uint64(now - atomic.LoadInt64(&slot.since))
+				s.Quality = linkQualityNames[q]
+			}
+			s.Durations[linkQualityNames[q]] = time.Duration(duration).Round(time.Second).String()
+			for r := 0; r < linkQualityLevels; r++ {
+				if count := atomic.LoadUint64(&slot.transitions[q][r]); count > 0 {
+					s.Transitions[linkQualityNames[q]+"->"+linkQualityNames[r]] = count
+				}
+			}
+		}
+		stats[strconv.Itoa(int(deviceID))] = s
+	}
+	return stats
+}
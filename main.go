@@ -18,7 +18,9 @@ char* testC(char* val) {
 */
 import "C"
 import (
+	"flag"
 	"log"
+	"os"
 	"sync"
 	"time"
 )
@@ -27,14 +29,160 @@ var deviceList = make(map[uint16]*DeviceInfo, 0)
 var deviceListLock = sync.Mutex{}
 var mainDevice *DeviceInfo
 
+var icsPath = flag.String("ics", "", "path to a local .ics calendar, busy during its events")
+var telemetryDir = flag.String("telemetry", "", "directory where device telemetry is stored")
+var telemetryRetention = flag.Duration("telemetry-retention", 30*24*time.Hour, "how long telemetry segments are kept")
+var statsAddr = flag.String("stats", "", "serve stats as JSON on this TCP address or unix socket path, endpoints that change devices are only served on a unix socket")
+var panicLog = flag.String("panic-log", "", "file where device panic codes are collected")
+var inventoryPath = flag.String("inventory", "", "file where the inventory of attached devices is kept")
+var exportInventory = flag.String("export-inventory", "", "print the -inventory as json or csv and exit")
+var settingsProfilePath = flag.String("settings-profile", "", "JSON file of setting values by GUID applied to every attached device")
+var complianceBaselinePath = flag.String("compliance-baseline", "", "JSON file of setting values by GUID that attached devices are compared against")
+var firmwareCache = flag.String("firmware-cache", "", "directory where firmware images are cached, enables firmware updates")
+var firmwareAuthorization = flag.String("firmware-auth", "", "authorization ID for the Jabra firmware cloud")
+var firmwareParallel = flag.Int("firmware-parallel", 2, "maximum number of firmware updates running at the same time")
+var firmwareAuto = flag.Bool("firmware-auto", false, "with -firmware-cache, schedule a firmware update of every attached device")
+var firmwareIdle = flag.Duration("firmware-idle", 10*time.Minute, "how long the user must be idle before a scheduled firmware update starts")
+var firmwareJitter = flag.Duration("firmware-jitter", 15*time.Minute, "maximum random delay between two scheduled firmware updates")
+var mirrorDir = flag.String("mirror", "", "serve the firmware and capabilities cloud endpoints from this directory and point the SDK at it")
+var mirrorAddr = flag.String("mirror-addr", "127.0.0.1:0", "address the -mirror server listens on")
+var occupancyEnabled = flag.Bool("occupancy", false, "sample the people count of attached cameras, served on /occupancy")
+var presetsPath = flag.String("presets", "", "file where named camera presets (pan/tilt/zoom and image) are kept")
+var diagnosticLogDir = flag.String("diagnostic-logs", "", "directory where compressed device diagnostic logs are archived, collected on panics and on demand")
+var diagnosticLogMax = flag.Int64("diagnostic-logs-max", 512<<20, "maximum size in bytes of the -diagnostic-logs archive, the oldest logs are deleted first")
+var diagnosticParallel = flag.Int("diagnostic-parallel", 2, "maximum number of diagnostic logs collected at the same time")
+var dumpTelemetry = flag.Bool("dump-telemetry", false, "print the telemetry stored in -telemetry and exit")
+var dumpFrom = flag.String("from", "", "with -dump-telemetry, first record time (RFC 3339 or relative like -24h)")
+var dumpTo = flag.String("to", "", "with -dump-telemetry, end time (RFC 3339 or relative like -1h)")
+var dumpSerial = flag.String("serial", "", "with -dump-telemetry, only print records of this serial number")
+
 func main() {
+	flag.Parse()
+	if *dumpTelemetry {
+		from, err := parseTelemetryTime(*dumpFrom)
+		if err != nil {
+			log.Fatalln("invalid -from:", err)
+		}
+		to, err := parseTelemetryTime(*dumpTo)
+		if err != nil {
+			log.Fatalln("invalid -to:", err)
+		}
+		if err := DumpTelemetry(os.Stdout, *telemetryDir, from, to, *dumpSerial); err != nil {
+			log.Fatalln(err)
+		}
+		return
+	}
+	if *exportInventory != "" {
+		if *inventoryPath == "" {
+			log.Fatalln("-export-inventory needs -inventory")
+		}
+		inv, err := ReadInventory(*inventoryPath)
+		if err != nil {
+			log.Fatalln("failed to load inventory:", err)
+		}
+		if err := inv.Export(os.Stdout, *exportInventory); err != nil {
+			log.Fatalln(err)
+		}
+		return
+	}
+	if *inventoryPath != "" {
+		inv, err := LoadInventory(*inventoryPath)
+		if err != nil {
+			log.Fatalln("failed to load inventory:", err)
+		}
+		inventory = inv
+	}
+	if *telemetryDir != "" {
+		store, err := NewTelemetryStore(*telemetryDir, *telemetryRetention)
+		if err != nil {
+			log.Fatalln("failed to open telemetry store:", err)
+		}
+		telemetry = store
+	}
+	if *panicLog != "" {
+		harvester, err := NewPanicHarvester(*panicLog)
+		if err != nil {
+			log.Fatalln("failed to open panic log:", err)
+		}
+		panics = harvester
+		go panics.Run()
+	}
+	if *presetsPath != "" {
+		library, err := LoadPresets(*presetsPath)
+		if err != nil {
+			log.Fatalln("failed to load presets:", err)
+		}
+		presets = library
+	}
+	if *occupancyEnabled {
+		occupancy = NewOccupancySampler()
+		go occupancy.Run()
+	}
+	if *settingsProfilePath != "" {
+		profile, err := LoadSettingsProfile(*settingsProfilePath)
+		if err != nil {
+			log.Fatalln("failed to load settings profile:", err)
+		}
+		settingsProfile = profile
+	}
+	if *complianceBaselinePath != "" {
+		profile, err := LoadSettingsProfile(*complianceBaselinePath)
+		if err != nil {
+			log.Fatalln("failed to load compliance baseline:", err)
+		}
+		complianceBaseline = NewComplianceBaseline(profile)
+	}
+	if *firmwareCache != "" {
+		updater, err := NewFirmwareUpdater(*firmwareCache, *firmwareAuthorization, *firmwareParallel)
+		if err != nil {
+			log.Fatalln("failed to open firmware cache:", err)
+		}
+		firmware = updater
+		firmwareScheduler = NewFirmwareScheduler(*firmwareIdle, *firmwareJitter)
+		firmwareScheduler.OnAttach = *firmwareAuto
+		go firmwareScheduler.Run()
+	}
+	if *diagnosticLogDir != "" {
+		collector, err := NewDiagnosticLogCollector(*diagnosticLogDir, *diagnosticLogMax, *diagnosticParallel)
+		if err != nil {
+			log.Fatalln("failed to open diagnostic log archive:", err)
+		}
+		diagnosticLogs = collector
+	}
 	log.Println(C.GoString(C.testC(C.CString("testing C binding: this line must be print"))))
 
+	var configParams *C.Config_params
+	if *mirrorDir != "" {
+		mirror := NewMirror(*mirrorDir)
+		if err := mirror.Listen(*mirrorAddr); err != nil {
+			log.Fatalln("failed to start mirror:", err)
+		}
+		configParams = mirror.config()
+	}
+
 	C.Jabra_SetAppID(C.CString("linux-busylight"))
-	init := C.Jabra_InitializeV2((*[0]byte)(C.goFirstscanfordevicesdonefunc), (*[0]byte)(C.goDeviceattachedfunc), (*[0]byte)(C.goDeviceremovedfunc), (*[0]byte)(C.goButtonindatarawhidfunc), (*[0]byte)(nil), true, nil)
+	init := C.Jabra_InitializeV2((*[0]byte)(C.goFirstscanfordevicesdonefunc), (*[0]byte)(C.goDeviceattachedfunc), (*[0]byte)(C.goDeviceremovedfunc), (*[0]byte)(C.goButtonindatarawhidfunc), (*[0]byte)(nil), true, configParams)
 	if !init {
 		log.Fatalln("failed to init jabra SDK")
 	}
+	registerBatteryTelemetry()
+	registerDectInfo()
+	registerLinkQuality()
+	registerCameraStatus()
+	registerNetworkStatus()
+	registerPairingList()
+	if firmware != nil {
+		registerFirmwareProgress()
+	}
+	if diagnosticLogs != nil {
+		registerDiagnosticLogs()
+	}
+	if *statsAddr != "" {
+		go serveStats(*statsAddr)
+	}
+	if *icsPath != "" {
+		go NewCalendar(*icsPath).Run()
+	}
 	for {
 		time.Sleep(60 * time.Second)
 	}
@@ -50,6 +198,15 @@ func goDeviceattachedfunc(cdeviceinfo C.Jabra_DeviceInfo) {
 	deviceInfo := NewDeviceInfo(cdeviceinfo)
 	log.Println("attach ", deviceInfo.DeviceName)
 	addDevice(deviceInfo)
+	watchLinkQuality(deviceInfo)
+	panics.Rebooted(deviceInfo)
+	inventory.Refresh(deviceInfo)
+	applySettingsProfile(deviceInfo)
+	checkComplianceOnAttach(deviceInfo)
+	firmwareScheduler.Attached(deviceInfo)
+	occupancy.Watch(deviceInfo)
+	watchNetworkStatus(deviceInfo)
+	watchPairingList(deviceInfo)
 }
 
 //export goDeviceremovedfunc
@@ -65,12 +222,8 @@ func goDeviceremovedfunc(deviceid uint16) {
 func goButtonindatarawhidfunc(deviceid uint16, usagepage uint16, usage uint16, buttonindata bool) {
 	log.Println(deviceid, usagepage, usage, buttonindata)
 
-	if mainDevice != nil && usagepage == 0xff30 && usage == 0x002a {
-		if buttonindata {
-			mainDevice.EnableBusylightStatus()
-		} else {
-			mainDevice.DisableBusylightStatus()
-		}
+	if usagepage == 0xff30 && usage == 0x002a {
+		setBusy(busySourceAudio, buttonindata)
 	}
 }
 
@@ -81,6 +234,7 @@ func addDevice(device *DeviceInfo) {
 		mainDevice = device
 	}
 	defer deviceListLock.Unlock()
+	defer refreshBusy()
 }
 
 func removeDevice(device *DeviceInfo) {
@@ -90,4 +244,26 @@ func removeDevice(device *DeviceInfo) {
 	}
 	delete(deviceList, device.DeviceID)
 	defer deviceListLock.Unlock()
+	removeDectInfo(device.DeviceID)
+	unwatchLinkQuality(device)
+	panics.Remove(device)
+	removeDeviceSettings(device)
+	removePTZ(device)
+	removeImageQuality(device)
+	occupancy.Remove(device)
+	removeCameraStatus(device)
+	removeNetworkStatus(device)
+	removePairingList(device)
+	firmware.Remove(device)
+}
+
+func findDevice(serialNumber string) *DeviceInfo {
+	deviceListLock.Lock()
+	defer deviceListLock.Unlock()
+	for _, device := range deviceList {
+		if device.SerialNumber == serialNumber {
+			return device
+		}
+	}
+	return nil
 }
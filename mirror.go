@@ -0,0 +1,148 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+*/
+import "C"
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"io"
+	"log"
+	"net"
+	"net/http"
+	"os"
+	"path"
+	"path/filepath"
+	"strings"
+	"sync"
+	"time"
+)
+
+// Mirror serves the firmware and capability endpoints of the Jabra cloud
+// from a local directory, for sites without internet access. A request for
+// /fw/<path>?<query> is answered with the file <dir>/fw/<path>/<query> (the
+// query with its parameters sorted), or <dir>/fw/<path> when there is none,
+// and the same goes for /capabilities. Range requests and conditional
+// requests on the ETag, a hash of the content, are supported.
+type Mirror struct {
+	Dir   string
+	Addr  string // address the mirror listens on, once started
+	lock  sync.Mutex
+	etags map[string]mirrorETag
+}
+
+// mirrorETag is the hash of a file, valid as long as its size and modification time match.
+type mirrorETag struct {
+	size    int64
+	modTime time.Time
+	etag    string
+}
+
+var mirrorEndpoints = []string{"fw", "capabilities"}
+
+func NewMirror(dir string) *Mirror {
+	return &Mirror{Dir: dir, etags: make(map[string]mirrorETag)}
+}
+
+// Listen binds the mirror before the SDK is initialized and serves it in the background.
+func (m *Mirror) Listen(addr string) error {
+	listener, err := net.Listen("tcp", addr)
+	if err != nil {
+		return err
+	}
+	m.Addr = listener.Addr().String()
+	log.Println("mirror listening on", m.Addr)
+	go func() {
+		if err := http.Serve(listener, m); err != nil {
+			log.Println("mirror:", err)
+		}
+	}()
+	return nil
+}
+
+// config returns SDK parameters pointing the cloud endpoints at the mirror,
+// the SDK keeps them so they are never freed.
+func (m *Mirror) config() *C.Config_params {
+	cloud := (*C.ConfigParams_cloud)(C.calloc(1, C.sizeof_ConfigParams_cloud))
+	cloud.baseUrl_fw = C.CString("http://" + m.Addr + "/fw")
+	cloud.baseUrl_capabilities = C.CString("http://" + m.Addr + "/capabilities")
+	params := (*C.Config_params)(C.calloc(1, C.sizeof_Config_params))
+	params.cloudConfig_params = cloud
+	return params
+}
+
+// open returns the file answering a request, the query specific one first.
+func (m *Mirror) open(r *http.Request) (*os.File, os.FileInfo, string) {
+	name := path.Clean("/" + r.URL.Path)
+	known := false
+	for _, endpoint := range mirrorEndpoints {
+		known = known || name == "/"+endpoint || strings.HasPrefix(name, "/"+endpoint+"/")
+	}
+	if !known {
+		return nil, nil, ""
+	}
+	names := []string{name}
+	if query := r.URL.Query(); len(query) > 0 {
+		names = []string{path.Join(name, query.Encode()), name}
+	}
+	for _, name := range names {
+		file, err := os.Open(filepath.Join(m.Dir, filepath.FromSlash(name)))
+		if err != nil {
+			continue
+		}
+		info, err := file.Stat()
+		if err != nil || info.IsDir() {
+			file.Close()
+			continue
+		}
+		return file, info, file.Name()
+	}
+	return nil, nil, ""
+}
+
+// etag hashes a file the first time it is served or after it changed.
+func (m *Mirror) etag(name string, info os.FileInfo, file *os.File) (string, error) {
+	m.lock.Lock()
+	cached, ok := m.etags[name]
+	m.lock.Unlock()
+	if ok && cached.size == info.Size() && cached.modTime.Equal(info.ModTime()) {
+		return cached.etag, nil
+	}
+	hash := sha256.New()
+	if _, err := io.Copy(hash, file); err != nil {
+		return "", err
+	}
+	if _, err := file.Seek(0, io.SeekStart); err != nil {
+		return "", err
+	}
+	etag := `"` + hex.EncodeToString(hash.Sum(nil)[:16]) + `"`
+	m.lock.Lock()
+	m.etags[name] = mirrorETag{size: info.Size(), modTime: info.ModTime(), etag: etag}
+	m.lock.Unlock()
+	return etag, nil
+}
+
+func (m *Mirror) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodGet && r.Method != http.MethodHead {
+		http.Error(w, "method not allowed", http.StatusMethodNotAllowed)
+		return
+	}
+	file, info, name := m.open(r)
+	if file == nil {
+		log.Println("mirror: not found", r.URL)
+		http.NotFound(w, r)
+		return
+	}
+	defer file.Close()
+	etag, err := m.etag(name, info, file)
+	if err != nil {
+		log.Println("mirror:", err)
+		http.Error(w, err.Error(), http.StatusInternalServerError)
+		return
+	}
+	w.Header().Set("ETag", etag)
+	// ServeContent handles Range, If-Range and If-None-Match
+	http.ServeContent(w, r, info.Name(), info.ModTime(), file)
+}
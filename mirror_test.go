@@ -0,0 +1,109 @@
+package main
+
+import (
+	"io"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"path/filepath"
+	"strconv"
+	"sync"
+	"testing"
+)
+
+func newTestMirror(t testing.TB, files map[string][]byte) *httptest.Server {
+	t.Helper()
+	dir := t.TempDir()
+	for name, data := range files {
+		path := filepath.Join(dir, filepath.FromSlash(name))
+		if err := os.MkdirAll(filepath.Dir(path), 0755); err != nil {
+			t.Fatal(err)
+		}
+		if err := os.WriteFile(path, data, 0644); err != nil {
+			t.Fatal(err)
+		}
+	}
+	server := httptest.NewServer(NewMirror(dir))
+	t.Cleanup(server.Close)
+	return server
+}
+
+func TestMirror(t *testing.T) {
+	server := newTestMirror(t, map[string][]byte{
+		"fw/image":             []byte("any version"),
+		"fw/versions/a=1&b=2":  []byte("version 2"),
+		"capabilities/product": []byte("{}"),
+	})
+	get := func(path string, header http.Header) (*http.Response, string) {
+		request, _ := http.NewRequest(http.MethodGet, server.URL+path, nil)
+		for name, values := range header {
+			request.Header[name] = values
+		}
+		response, err := http.DefaultClient.Do(request)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer response.Body.Close()
+		body, _ := io.ReadAll(response.Body)
+		return response, string(body)
+	}
+
+	for path, want := range map[string]string{
+		"/fw/image":             "any version",
+		"/fw/versions?b=2&a=1":  "version 2", // parameters in any order
+		"/fw/image?a=3":         "any version",
+		"/capabilities/product": "{}",
+	} {
+		if _, body := get(path, nil); body != want {
+			t.Errorf("GET %s = %q, want %q", path, body, want)
+		}
+	}
+	if response, _ := get("/other", nil); response.StatusCode != http.StatusNotFound {
+		t.Errorf("GET /other = %d, want 404", response.StatusCode)
+	}
+	response, _ := get("/fw/image", nil)
+	etag := response.Header.Get("ETag")
+	if response, _ := get("/fw/image", http.Header{"If-None-Match": {etag}}); response.StatusCode != http.StatusNotModified {
+		t.Errorf("conditional GET = %d, want 304", response.StatusCode)
+	}
+	if response, body := get("/fw/image", http.Header{"Range": {"bytes=4-"}}); response.StatusCode != http.StatusPartialContent || body != "version" {
+		t.Errorf("range GET = %d %q", response.StatusCode, body)
+	}
+}
+
+// BenchmarkMirrorDownload downloads a 50 MB image with 1, 8 and 32
+// concurrent clients on loopback, the reported throughput is aggregated.
+func BenchmarkMirrorDownload(b *testing.B) {
+	const size = 50 << 20
+	server := newTestMirror(b, map[string][]byte{"fw/image": make([]byte, size)})
+	for _, clients := range []int{1, 8, 32} {
+		b.Run(strconv.Itoa(clients), func(b *testing.B) {
+			b.SetBytes(size)
+			client := &http.Client{Transport: &http.Transport{MaxIdleConnsPerHost: clients}}
+			downloads := make(chan struct{})
+			wg := sync.WaitGroup{}
+			for c := 0; c < clients; c++ {
+				wg.Add(1)
+				go func() {
+					defer wg.Done()
+					for range downloads {
+						response, err := client.Get(server.URL + "/fw/image")
+						if err != nil {
+							b.Error(err)
+							continue
+						}
+						if n, _ := io.Copy(io.Discard, response.Body); n != size {
+							b.Errorf("downloaded %d bytes, want %d", n, size)
+						}
+						response.Body.Close()
+					}
+				}()
+			}
+			for i := 0; i < b.N; i++ {
+				downloads <- struct{}{}
+			}
+			close(downloads)
+			wg.Wait()
+		})
+	}
+}
@@ -0,0 +1,190 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Network.h"
+extern void goNetworkstatusfunc(unsigned short deviceID, NetworkInterface ifc, NetworkInterfaceStatus status);
+*/
+import "C"
+import (
+	"fmt"
+	"net"
+	"strconv"
+	"sync"
+)
+
+type NetworkInterfaceStatus struct {
+	Enabled    bool
+	DHCP       bool
+	Connected  bool
+	LinkUp     bool
+	IP         string `json:",omitempty"`
+	SubnetMask string `json:",omitempty"`
+	MAC        string `json:",omitempty"`
+}
+
+type NetworkStatus struct {
+	Ethernet *NetworkInterfaceStatus `json:",omitempty"`
+	WLAN     *NetworkInterfaceStatus `json:",omitempty"`
+}
+
+// network status of the attached network devices, read once on attach and
+// then only when the SDK reports a change, reads are served from memory
+var networkDevices = make(map[uint16]*NetworkStatus, 0)
+var networkLock = sync.Mutex{}
+
+type networkKey struct {
+	deviceID uint16
+	ifc      C.NetworkInterface
+}
+
+// number of changes reported for each interface, a read back stored after a
+// newer change keeps the link state of the cache
+var networkSequences = make(map[networkKey]uint64)
+
+func registerNetworkStatus() {
+	C.Jabra_RegisterNetworkStatusChangedCallback((*[0]byte)(C.goNetworkstatusfunc))
+	registerStats("network", networkStats)
+}
+
+func watchNetworkStatus(device *DeviceInfo) {
+	if device.IsDongle {
+		return
+	}
+	deviceID := device.DeviceID
+	backgroundWorker.SubmitRetry(func() {
+		status := NetworkStatus{
+			Ethernet: readNetworkInterface(deviceID, C.Interface_Ethernet, ""),
+			WLAN:     readNetworkInterface(deviceID, C.Interface_WLAN, ""),
+		}
+		if status.Ethernet == nil && status.WLAN == nil {
+			return
+		}
+		networkLock.Lock()
+		networkDevices[deviceID] = &status
+		networkLock.Unlock()
+	})
+}
+
+func removeNetworkStatus(device *DeviceInfo) {
+	networkLock.Lock()
+	defer networkLock.Unlock()
+	delete(networkDevices, device.DeviceID)
+	delete(networkSequences, networkKey{device.DeviceID, C.Interface_Ethernet})
+	delete(networkSequences, networkKey{device.DeviceID, C.Interface_WLAN})
+}
+
+// readNetworkInterface reads the IPv4 status of an interface, and its MAC
+// address unless it is already known, it returns nil if the device does not
+// have the interface.
+func readNetworkInterface(deviceID uint16, ifc C.NetworkInterface, mac string) *NetworkInterfaceStatus {
+	id := C.ushort(deviceID)
+	var ipv4 C.IPv4Status
+	var ret C.Jabra_ReturnCode
+	if ifc == C.Interface_Ethernet {
+		ret = C.Jabra_GetEthernetIPv4Status(id, &ipv4)
+	} else {
+		ret = C.Jabra_GetWLANIPv4Status(id, &ipv4)
+	}
+	if ret != C.Return_Ok {
+		return nil
+	}
+	status := &NetworkInterfaceStatus{
+		Enabled:   bool(ipv4.InterfaceEnabled),
+		DHCP:      bool(ipv4.DHCPEnabled),
+		Connected: bool(ipv4.ConnectionStatus),
+		LinkUp:    bool(ipv4.ConnectionStatus),
+		MAC:       mac,
+	}
+	if status.Connected {
+		status.IP = net.IPv4(byte(ipv4.IP.octet1), byte(ipv4.IP.octet2), byte(ipv4.IP.octet3), byte(ipv4.IP.octet4)).String()
+		status.SubnetMask = net.IPv4(byte(ipv4.SubNetMask.octet1), byte(ipv4.SubNetMask.octet2), byte(ipv4.SubNetMask.octet3), byte(ipv4.SubNetMask.octet4)).String()
+	}
+	var addr [6]C.uint8_t
+	if mac == "" && C.Jabra_GetMACAddress(id, ifc, &addr[0]) == C.Return_Ok {
+		status.MAC = fmt.Sprintf("%02x:%02x:%02x:%02x:%02x:%02x", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5])
+	}
+	return status
+}
+
+// networkInterface returns the cached status of an interface, networkLock must be held.
+func (s *NetworkStatus) networkInterface(ifc C.NetworkInterface) **NetworkInterfaceStatus {
+	switch ifc {
+	case C.Interface_Ethernet:
+		return &s.Ethernet
+	case C.Interface_WLAN:
+		return &s.WLAN
+	}
+	return nil
+}
+
+//export goNetworkstatusfunc
+func goNetworkstatusfunc(deviceid uint16, ifc C.NetworkInterface, status C.NetworkInterfaceStatus) {
+	networkLock.Lock()
+	device, ok := networkDevices[deviceid]
+	if !ok {
+		networkLock.Unlock()
+		return
+	}
+	cached := device.networkInterface(ifc)
+	if cached == nil {
+		networkLock.Unlock()
+		return
+	}
+	// cached statuses are never modified, they are replaced
+	old := *cached
+	key := networkKey{deviceid, ifc}
+	networkSequences[key]++
+	sequence := networkSequences[key]
+	// link changes are known from the event alone, address changes are read back
+	if old != nil && (status == C.NETWORK_LINK_UP || status == C.NETWORK_LINK_DOWN) {
+		updated := *old
+		updated.LinkUp = status == C.NETWORK_LINK_UP
+		*cached = &updated
+		networkLock.Unlock()
+		return
+	}
+	networkLock.Unlock()
+
+	mac := ""
+	if old != nil {
+		mac = old.MAC
+	}
+	backgroundWorker.SubmitRetry(func() {
+		updated := readNetworkInterface(deviceid, ifc, mac)
+		networkLock.Lock()
+		defer networkLock.Unlock()
+		device, ok := networkDevices[deviceid]
+		if !ok {
+			return
+		}
+		// a link change reported since the read was queued is newer than the read
+		cached := device.networkInterface(ifc)
+		if networkSequences[key] != sequence && updated != nil && *cached != nil {
+			updated.LinkUp = (*cached).LinkUp
+		}
+		*cached = updated
+	})
+}
+
+// NetworkDeviceStatus returns the cached network status of a device.
+func NetworkDeviceStatus(deviceID uint16) (NetworkStatus, bool) {
+	networkLock.Lock()
+	defer networkLock.Unlock()
+	status, ok := networkDevices[deviceID]
+	if !ok {
+		return NetworkStatus{}, false
+	}
+	return *status, true
+}
+
+func networkStats() interface{} {
+	networkLock.Lock()
+	defer networkLock.Unlock()
+	stats := make(map[string]NetworkStatus, len(networkDevices))
+	for deviceID, status := range networkDevices {
+		stats[strconv.Itoa(int(deviceID))] = *status
+	}
+	return stats
+}
@@ -0,0 +1,208 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Video.h"
+*/
+import "C"
+import (
+	"log"
+	"math"
+	"net/http"
+	"sync"
+	"time"
+)
+
+const (
+	// cameras are sampled more often while they stream, that is during meetings
+	occupancyIntervalStreaming = 10 * time.Second
+	occupancyIntervalIdle      = 2 * time.Minute
+)
+
+// OccupancySample is a people count, or the rollup of the counts of a
+// period starting at Time for the minute and hour tiers.
+type OccupancySample struct {
+	Time    int64 // unix seconds
+	Min     int16
+	Max     int16
+	Average float32
+}
+
+func (s OccupancySample) sampleTime() int64 { return s.Time }
+
+// occupancyRollup keeps the minimum, maximum and average count of a period.
+type occupancyRollup struct {
+	min int16
+	max int16
+	sum float64
+}
+
+func newOccupancyRollup() *occupancyRollup {
+	return &occupancyRollup{min: math.MaxInt16, max: math.MinInt16}
+}
+
+func (r *occupancyRollup) add(s OccupancySample) {
+	if s.Min < r.min {
+		r.min = s.Min
+	}
+	if s.Max > r.max {
+		r.max = s.Max
+	}
+	r.sum += float64(s.Average)
+}
+
+func (r *occupancyRollup) result(period int64, count int) OccupancySample {
+	s := OccupancySample{Time: period, Min: r.min, Max: r.max, Average: float32(r.sum / float64(count))}
+	*r = *newOccupancyRollup()
+	return s
+}
+
+// OccupancySeries keeps the people counts of a camera: the raw samples,
+// and 1 minute and 1 hour rollups.
+type OccupancySeries struct {
+	raw    sampleRing[OccupancySample]
+	minute sampleTier[OccupancySample]
+	hour   sampleTier[OccupancySample]
+}
+
+func newOccupancySeries() *OccupancySeries {
+	return &OccupancySeries{
+		raw:    newSampleRing[OccupancySample](1024),
+		minute: newSampleTier[OccupancySample](60, 24*60, newOccupancyRollup()),
+		hour:   newSampleTier[OccupancySample](3600, 90*24, newOccupancyRollup()),
+	}
+}
+
+func (o *OccupancySeries) add(s OccupancySample) {
+	o.raw.push(s)
+	o.minute.add(s)
+	o.hour.add(s)
+}
+
+// OccupancySampler polls the people count of the attached cameras.
+type OccupancySampler struct {
+	polls  *pollScheduler
+	lock   sync.Mutex
+	series map[string]*OccupancySeries // by serial number
+}
+
+// occupancy is nil unless the daemon was started with -occupancy.
+var occupancy *OccupancySampler
+
+func NewOccupancySampler() *OccupancySampler {
+	o := &OccupancySampler{series: make(map[string]*OccupancySeries)}
+	o.polls = newPollScheduler(occupancyIntervalIdle, occupancyIntervalStreaming, o.sample)
+	registerStats("occupancy", o.stats)
+	return o
+}
+
+// Watch starts sampling a device, it stops at the first sample if the
+// device does not count people.
+func (o *OccupancySampler) Watch(device *DeviceInfo) {
+	if o == nil || device.IsDongle {
+		return
+	}
+	o.polls.Schedule(device.DeviceID, device.SerialNumber, occupancyIntervalIdle, 0)
+}
+
+func (o *OccupancySampler) Remove(device *DeviceInfo) {
+	if o == nil {
+		return
+	}
+	o.polls.Remove(device.DeviceID)
+}
+
+func (o *OccupancySampler) Run() {
+	o.polls.Run()
+}
+
+// sample runs on the background worker.
+func (o *OccupancySampler) sample(deviceID uint16, serialNumber string) {
+	id := C.ushort(deviceID)
+	var people C.int16_t
+	ret := C.Jabra_GetPeopleCount(id, &people)
+	var streaming C.bool
+	C.Jabra_IsCameraStreaming(id, &streaming)
+	now := time.Now()
+
+	o.polls.Done(deviceID, func(time.Duration) time.Duration {
+		switch {
+		case ret == C.Not_Supported:
+			return -1
+		case bool(streaming):
+			return occupancyIntervalStreaming
+		}
+		return occupancyIntervalIdle
+	})
+	o.lock.Lock()
+	if ret == C.Return_Ok {
+		series, ok := o.series[serialNumber]
+		if !ok {
+			series = newOccupancySeries()
+			o.series[serialNumber] = series
+		}
+		series.add(OccupancySample{Time: now.Unix(), Min: int16(people), Max: int16(people), Average: float32(people)})
+	} else if ret != C.Not_Supported {
+		log.Printf("occupancy: failed to read people count of device %d: %d", deviceID, int(ret))
+	}
+	o.lock.Unlock()
+}
+
+// History returns the samples of a tier ("raw", "minute" or "hour") from from to to.
+func (o *OccupancySampler) History(serialNumber string, tier string, from, to time.Time) []OccupancySample {
+	o.lock.Lock()
+	defer o.lock.Unlock()
+	series, ok := o.series[serialNumber]
+	if !ok {
+		return nil
+	}
+	if to.IsZero() {
+		to = time.Now().Add(time.Hour)
+	}
+	switch tier {
+	case "minute":
+		return series.minute.ring.between(from.Unix(), to.Unix())
+	case "hour":
+		return series.hour.ring.between(from.Unix(), to.Unix())
+	default:
+		return series.raw.between(from.Unix(), to.Unix())
+	}
+}
+
+func (o *OccupancySampler) stats() interface{} {
+	o.lock.Lock()
+	defer o.lock.Unlock()
+	stats := make(map[string]OccupancySample, len(o.series))
+	for serialNumber, series := range o.series {
+		if last, ok := series.raw.last(); ok {
+			stats[serialNumber] = last
+		}
+	}
+	return stats
+}
+
+// serveOccupancy returns the people counts of ?serial= in the ?tier= (raw,
+// minute or hour) between ?from= and ?to=, as RFC 3339 or relative times.
+func serveOccupancy(w http.ResponseWriter, r *http.Request) {
+	if occupancy == nil {
+		http.Error(w, "occupancy sampling disabled", http.StatusNotFound)
+		return
+	}
+	query := r.URL.Query()
+	from, err := parseTelemetryTime(query.Get("from"))
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusBadRequest)
+		return
+	}
+	to, err := parseTelemetryTime(query.Get("to"))
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusBadRequest)
+		return
+	}
+	writeJSON(w, occupancy.History(query.Get("serial"), query.Get("tier"), from, to))
+}
+
+func init() {
+	statsMux.HandleFunc("/occupancy", serveOccupancy)
+}
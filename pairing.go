@@ -0,0 +1,343 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Bluetooth.h"
+extern void goPairinglistfunc(unsigned short deviceID, Jabra_PairingList* list);
+*/
+import "C"
+import (
+	"errors"
+	"fmt"
+	"log"
+	"net"
+	"net/http"
+	"strconv"
+	"sync"
+	"unsafe"
+)
+
+type PairedDevice struct {
+	Name      string
+	Address   string
+	Connected bool
+}
+
+type pairingRequest struct {
+	address string
+	connect bool
+	done    chan error
+}
+
+// pairingDongle holds the pairing list of a Bluetooth dongle and the
+// connect/disconnect requests waiting to be sent to it.
+type pairingDongle struct {
+	devices  []PairedDevice
+	queue    []*pairingRequest
+	draining bool
+}
+
+// pairing lists of the attached dongles, read once on attach and then only
+// replaced by the pairing list callback, reads are served from memory.
+// deviceListLock is never taken while holding pairingLock, entries are only
+// created while holding both, so that removeDevice deletes them.
+var pairingDongles = make(map[uint16]*pairingDongle, 0)
+var pairingLock = sync.Mutex{}
+
+var pairingRequests, pairingBatches, pairingCalls int64
+
+var errPairingSuperseded = errors.New("superseded by a later connect request")
+
+func registerPairingList() {
+	C.Jabra_RegisterPairingListCallback((*[0]byte)(C.goPairinglistfunc))
+	registerStats("pairing", pairingStats)
+}
+
+func watchPairingList(device *DeviceInfo) {
+	deviceID := device.DeviceID
+	backgroundWorker.SubmitRetry(func() {
+		id := C.ushort(deviceID)
+		if !C.Jabra_IsPairingListSupported(id) {
+			return
+		}
+		var devices []PairedDevice
+		if list := C.Jabra_GetPairingList(id); list != nil {
+			devices = readPairingList(list)
+			C.Jabra_FreePairingList(list)
+		}
+		deviceListLock.Lock()
+		defer deviceListLock.Unlock()
+		pairingLock.Lock()
+		defer pairingLock.Unlock()
+		if dongle, ok := pairingDongles[deviceID]; ok {
+			dongle.devices = devices
+		} else if deviceList[deviceID] == device {
+			pairingDongles[deviceID] = &pairingDongle{devices: devices}
+		}
+	})
+}
+
+func removePairingList(device *DeviceInfo) {
+	pairingLock.Lock()
+	defer pairingLock.Unlock()
+	dongle, ok := pairingDongles[device.DeviceID]
+	if !ok {
+		return
+	}
+	for _, request := range dongle.queue {
+		request.done <- errors.New(device.DeviceName + " removed")
+	}
+	dongle.queue = nil
+	delete(pairingDongles, device.DeviceID)
+}
+
+func readPairingList(list *C.Jabra_PairingList) []PairedDevice {
+	devices := make([]PairedDevice, 0, int(list.count))
+	if list.pairedDevice == nil {
+		return devices
+	}
+	for _, entry := range unsafe.Slice(list.pairedDevice, int(list.count)) {
+		address := make(net.HardwareAddr, len(entry.deviceBTAddr))
+		for i, b := range entry.deviceBTAddr {
+			address[i] = byte(b)
+		}
+		devices = append(devices, PairedDevice{
+			Name:      C.GoString(entry.deviceName),
+			Address:   address.String(),
+			Connected: bool(entry.isConnected),
+		})
+	}
+	return devices
+}
+
+//export goPairinglistfunc
+func goPairinglistfunc(deviceid uint16, list *C.Jabra_PairingList) {
+	if list == nil {
+		return
+	}
+	devices := readPairingList(list)
+	C.Jabra_FreePairingList(list)
+	// the list is complete, so it also creates the entry of a dongle whose
+	// initial read has not run yet. deviceListLock is held until the entry
+	// is stored, removeDevice cannot run in between and leave it behind.
+	deviceListLock.Lock()
+	defer deviceListLock.Unlock()
+	_, attached := deviceList[deviceid]
+	pairingLock.Lock()
+	defer pairingLock.Unlock()
+	if dongle, ok := pairingDongles[deviceid]; ok {
+		dongle.devices = devices
+	} else if attached {
+		pairingDongles[deviceid] = &pairingDongle{devices: devices}
+	}
+}
+
+// PairingList returns the cached pairing list of a dongle.
+func PairingList(deviceID uint16) ([]PairedDevice, bool) {
+	pairingLock.Lock()
+	defer pairingLock.Unlock()
+	dongle, ok := pairingDongles[deviceID]
+	if !ok {
+		return nil, false
+	}
+	return append([]PairedDevice(nil), dongle.devices...), true
+}
+
+// ConnectPaired connects (or disconnects) a paired device and blocks until
+// it is done. Requests are queued per dongle and sent in batches, where
+// only the last request for a device counts.
+func ConnectPaired(deviceID uint16, address string, connect bool) error {
+	hw, err := net.ParseMAC(address)
+	if err != nil || len(hw) != 6 {
+		return fmt.Errorf("invalid Bluetooth address %q", address)
+	}
+	request := &pairingRequest{address: hw.String(), connect: connect, done: make(chan error, 1)}
+	pairingLock.Lock()
+	dongle, ok := pairingDongles[deviceID]
+	if !ok {
+		pairingLock.Unlock()
+		return errors.New("no pairing list on this device")
+	}
+	pairingRequests++
+	dongle.queue = append(dongle.queue, request)
+	if !dongle.draining {
+		dongle.draining = true
+		go drainPairingQueue(deviceID, dongle)
+	}
+	pairingLock.Unlock()
+	return <-request.done
+}
+
+// drainPairingQueue sends the queued requests of a dongle until none are left.
+func drainPairingQueue(deviceID uint16, dongle *pairingDongle) {
+	for {
+		pairingLock.Lock()
+		batch := dongle.queue
+		dongle.queue = nil
+		if len(batch) == 0 {
+			dongle.draining = false
+			pairingLock.Unlock()
+			return
+		}
+		pairingBatches++
+		devices := append([]PairedDevice(nil), dongle.devices...)
+		pairingLock.Unlock()
+
+		results := sendPairingBatch(deviceID, devices, batch)
+		pairingLock.Lock()
+		pairingCalls += int64(results.calls)
+		for i := range dongle.devices {
+			if connected, ok := results.connected[dongle.devices[i].Address]; ok {
+				dongle.devices[i].Connected = connected
+			}
+		}
+		pairingLock.Unlock()
+		for _, request := range batch {
+			request.done <- results.errors[request]
+		}
+	}
+}
+
+type pairingResults struct {
+	connected map[string]bool // addresses whose state changed
+	errors    map[*pairingRequest]error
+	calls     int
+}
+
+// sendPairingBatch merges a batch of requests and sends them in a single
+// worker job. Only one paired device can be connected at a time, so the last
+// connect request wins and the other connected devices are disconnected first.
+func sendPairingBatch(deviceID uint16, devices []PairedDevice, batch []*pairingRequest) pairingResults {
+	results := pairingResults{connected: make(map[string]bool), errors: make(map[*pairingRequest]error)}
+	wanted := make(map[string]bool)
+	for _, request := range batch {
+		wanted[request.address] = request.connect
+	}
+	// the last device still wanted connected once every request is merged
+	connectTo := ""
+	for i := len(batch) - 1; i >= 0; i-- {
+		if wanted[batch[i].address] {
+			connectTo = batch[i].address
+			break
+		}
+	}
+	known := make(map[string]PairedDevice, len(devices))
+	for _, device := range devices {
+		known[device.Address] = device
+	}
+
+	type pairingCall struct {
+		device  PairedDevice
+		connect bool
+	}
+	var calls []pairingCall
+	failed := make(map[string]error)
+	for address, connect := range wanted {
+		device, ok := known[address]
+		switch {
+		case !ok:
+			failed[address] = errors.New("no paired device " + address)
+		case connect && address != connectTo:
+			failed[address] = errPairingSuperseded
+		case !connect && device.Connected:
+			calls = append(calls, pairingCall{device, false})
+		}
+	}
+	if target, ok := known[connectTo]; ok && !target.Connected {
+		for _, device := range devices {
+			connect, requested := wanted[device.Address]
+			// explicit disconnects are already in calls
+			if device.Connected && device.Address != connectTo && (!requested || connect) {
+				calls = append(calls, pairingCall{device, false})
+			}
+		}
+		calls = append(calls, pairingCall{target, true})
+	}
+
+	results.calls = len(calls)
+	if len(calls) > 0 {
+		queued := backgroundWorker.Do(func() {
+			id := C.ushort(deviceID)
+			for _, call := range calls {
+				var cdevice C.Jabra_PairedDevice
+				cdevice.deviceName = C.CString(call.device.Name)
+				hw, _ := net.ParseMAC(call.device.Address)
+				for i := range cdevice.deviceBTAddr {
+					cdevice.deviceBTAddr[i] = C.uint8_t(hw[i])
+				}
+				cdevice.isConnected = C.bool(call.device.Connected)
+				var ret C.Jabra_ReturnCode
+				if call.connect {
+					ret = C.Jabra_ConnectPairedDevice(id, &cdevice)
+				} else {
+					ret = C.Jabra_DisConnectPairedDevice(id, &cdevice)
+				}
+				C.free(unsafe.Pointer(cdevice.deviceName))
+				verb := "disconnect"
+				if call.connect {
+					verb = "connect"
+				}
+				switch {
+				case ret == C.Return_Ok, call.connect && ret == C.Device_AlreadyConnected, !call.connect && ret == C.Device_NotConnected:
+					results.connected[call.device.Address] = call.connect
+				default:
+					failed[call.device.Address] = fmt.Errorf("failed to %s %s: %d", verb, call.device.Address, int(ret))
+					log.Println("pairing:", failed[call.device.Address])
+				}
+			}
+		})
+		if !queued {
+			for _, call := range calls {
+				failed[call.device.Address] = errors.New("device worker queue full")
+			}
+		}
+	}
+	for _, request := range batch {
+		results.errors[request] = failed[request.address]
+	}
+	return results
+}
+
+func pairingStats() interface{} {
+	pairingLock.Lock()
+	defer pairingLock.Unlock()
+	stats := struct {
+		Devices  map[string][]PairedDevice
+		Requests int64
+		Batches  int64
+		Calls    int64
+	}{make(map[string][]PairedDevice, len(pairingDongles)), pairingRequests, pairingBatches, pairingCalls}
+	for deviceID, dongle := range pairingDongles {
+		stats.Devices[strconv.Itoa(int(deviceID))] = dongle.devices
+	}
+	return stats
+}
+
+// servePairing returns the cached pairing list of the dongle given by
+// ?serial=, POST with ?address= and connect=1 or 0 connects or disconnects
+// a paired device.
+func servePairing(w http.ResponseWriter, r *http.Request) {
+	device := findDevice(r.URL.Query().Get("serial"))
+	if device == nil {
+		http.Error(w, "no attached device "+r.URL.Query().Get("serial"), http.StatusNotFound)
+		return
+	}
+	if r.Method == http.MethodPost {
+		connect := r.URL.Query().Get("connect") != "0"
+		if err := ConnectPaired(device.DeviceID, r.URL.Query().Get("address"), connect); err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+	}
+	devices, ok := PairingList(device.DeviceID)
+	if !ok {
+		http.Error(w, device.DeviceName+" has no pairing list", http.StatusNotImplemented)
+		return
+	}
+	writeJSON(w, devices)
+}
+
+func init() {
+	registerControl("/pairing", servePairing)
+}
@@ -0,0 +1,188 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+*/
+import "C"
+import (
+	"bufio"
+	"bytes"
+	"encoding/hex"
+	"fmt"
+	"log"
+	"os"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+	"unsafe"
+)
+
+const (
+	// devices are polled shortly after they (re)boot, then less and less often
+	panicIntervalMin = 30 * time.Second
+	panicIntervalMax = 6 * time.Hour
+)
+
+// PanicHarvester collects device panic codes into an append-only log and
+// clears them on the device once they are synced to disk.
+type PanicHarvester struct {
+	Path  string
+	polls *pollScheduler
+	lock  sync.Mutex
+	// sorted codes already logged, per serial number
+	seen map[string][]string
+}
+
+// panics is nil unless the daemon was started with -panic-log.
+var panics *PanicHarvester
+
+func NewPanicHarvester(path string) (*PanicHarvester, error) {
+	h := &PanicHarvester{Path: path, seen: make(map[string][]string)}
+	h.polls = newPollScheduler(panicIntervalMax, panicIntervalMin, h.harvest)
+	file, err := os.Open(path)
+	if err == nil {
+		defer file.Close()
+		scanner := bufio.NewScanner(file)
+		for scanner.Scan() {
+			fields := strings.Fields(scanner.Text())
+			if len(fields) == 3 {
+				h.insert(fields[1], fields[2])
+			}
+		}
+	} else if !os.IsNotExist(err) {
+		return nil, err
+	}
+	registerStats("panics", h.stats)
+	return h, nil
+}
+
+// insert adds a code to the seen set of a device and returns false if it was already there, h.lock must be held.
+func (h *PanicHarvester) insert(serialNumber string, code string) bool {
+	codes := h.seen[serialNumber]
+	i := sort.SearchStrings(codes, code)
+	if i < len(codes) && codes[i] == code {
+		return false
+	}
+	codes = append(codes, "")
+	copy(codes[i+1:], codes[i:])
+	codes[i] = code
+	h.seen[serialNumber] = codes
+	return true
+}
+
+// Rebooted schedules a device for a poll soon, it is called on attach and
+// when a settings write returns Device_Rebooted. A device rebooted by a
+// firmware update or a crash is attached again, so attach covers it.
+func (h *PanicHarvester) Rebooted(device *DeviceInfo) {
+	if h == nil {
+		return
+	}
+	h.polls.Schedule(device.DeviceID, device.SerialNumber, panicIntervalMin, panicIntervalMin)
+}
+
+func (h *PanicHarvester) Remove(device *DeviceInfo) {
+	if h == nil {
+		return
+	}
+	h.polls.Remove(device.DeviceID)
+}
+
+func (h *PanicHarvester) Run() {
+	h.polls.Run()
+}
+
+// harvest runs on the background worker.
+func (h *PanicHarvester) harvest(deviceID uint16, serialNumber string) {
+	var codes []string
+	if list := C.Jabra_GetPanics(C.ushort(deviceID)); list != nil {
+		for _, entry := range unsafe.Slice(list.panicList, int(list.entriesNo)) {
+			code := C.GoBytes(unsafe.Pointer(&entry.panicCode[0]), C.int(len(entry.panicCode)))
+			codes = append(codes, hex.EncodeToString(bytes.TrimRight(code, "\x00")))
+		}
+		C.Jabra_FreePanicListType(list)
+	}
+	var panicCodes C.Jabra_PanicCodes
+	if C.Jabra_GetPanicCodes(C.ushort(deviceID), &panicCodes) == C.Return_Ok {
+		for i := 0; i < int(panicCodes.size) && i < len(panicCodes.codes); i++ {
+			codes = append(codes, fmt.Sprintf("%04x", uint16(panicCodes.codes[i])))
+		}
+	}
+
+	found := len(codes) > 0
+	if found {
+		fresh, err := h.persist(serialNumber, codes)
+		if err != nil {
+			// keep the codes on the device until they can be written
+			log.Println("panics:", err)
+		} else if ret := C.Jabra_ClearPanicCodes(C.ushort(deviceID)); ret != C.Return_Ok {
+			log.Printf("panics: failed to clear panic codes on device %d: %d", deviceID, int(ret))
+		}
+		if fresh > 0 {
+			diagnosticLogs.CollectAsync(deviceID, serialNumber, "panic")
+		}
+	}
+
+	h.polls.Done(deviceID, func(interval time.Duration) time.Duration {
+		if found {
+			return panicIntervalMin
+		}
+		if interval *= 4; interval > panicIntervalMax {
+			return panicIntervalMax
+		}
+		return interval
+	})
+}
+
+// persist appends the codes not logged yet and syncs the log before they
+// are considered seen, it returns the number of new codes.
+func (h *PanicHarvester) persist(serialNumber string, codes []string) (int, error) {
+	h.lock.Lock()
+	var fresh []string
+	for _, code := range codes {
+		i := sort.SearchStrings(h.seen[serialNumber], code)
+		if i == len(h.seen[serialNumber]) || h.seen[serialNumber][i] != code {
+			fresh = append(fresh, code)
+		}
+	}
+	h.lock.Unlock()
+	if len(fresh) == 0 {
+		return 0, nil
+	}
+
+	file, err := os.OpenFile(h.Path, os.O_WRONLY|os.O_APPEND|os.O_CREATE, 0644)
+	if err != nil {
+		return 0, err
+	}
+	defer file.Close()
+	now := time.Now().Format(time.RFC3339)
+	out := bufio.NewWriter(file)
+	for _, code := range fresh {
+		fmt.Fprintf(out, "%s %s %s\n", now, serialNumber, code)
+	}
+	if err := out.Flush(); err != nil {
+		return 0, err
+	}
+	if err := file.Sync(); err != nil {
+		return 0, err
+	}
+
+	h.lock.Lock()
+	for _, code := range fresh {
+		h.insert(serialNumber, code)
+	}
+	h.lock.Unlock()
+	log.Printf("panics: %d new panic codes on %s: %s", len(fresh), serialNumber, strings.Join(fresh, " "))
+	return len(fresh), nil
+}
+
+func (h *PanicHarvester) stats() interface{} {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	stats := make(map[string][]string, len(h.seen))
+	for serialNumber, codes := range h.seen {
+		stats[serialNumber] = append([]string(nil), codes...)
+	}
+	return stats
+}
@@ -0,0 +1,121 @@
+package main
+
+import (
+	"sync"
+	"time"
+)
+
+// polledDevice is the poll state of a device. Interval is left to the
+// owner of the scheduler, to back off or speed up between polls.
+type polledDevice struct {
+	SerialNumber string
+	Interval     time.Duration
+	next         time.Time
+	pending      bool
+}
+
+// pollScheduler runs a poll of each device on the background worker when
+// it is due, one poll per device at a time. A poll reports back with Done.
+type pollScheduler struct {
+	// longest sleep between two scans, and delay before trying again when
+	// the worker queue is full
+	MaxWait time.Duration
+	Retry   time.Duration
+	poll    func(deviceID uint16, serialNumber string)
+	lock    sync.Mutex
+	devices map[uint16]*polledDevice
+	wake    chan struct{}
+}
+
+func newPollScheduler(maxWait, retry time.Duration, poll func(deviceID uint16, serialNumber string)) *pollScheduler {
+	return &pollScheduler{
+		MaxWait: maxWait,
+		Retry:   retry,
+		poll:    poll,
+		devices: make(map[uint16]*polledDevice),
+		wake:    make(chan struct{}, 1),
+	}
+}
+
+// Schedule polls a device in delay, and sets its interval. A poll already
+// queued for the device is not repeated.
+func (s *pollScheduler) Schedule(deviceID uint16, serialNumber string, interval, delay time.Duration) {
+	s.lock.Lock()
+	d, ok := s.devices[deviceID]
+	if !ok {
+		d = &polledDevice{SerialNumber: serialNumber}
+		s.devices[deviceID] = d
+	}
+	d.Interval = interval
+	d.next = time.Now().Add(delay)
+	s.lock.Unlock()
+	s.notify()
+}
+
+func (s *pollScheduler) Remove(deviceID uint16) {
+	s.lock.Lock()
+	delete(s.devices, deviceID)
+	s.lock.Unlock()
+}
+
+// Done ends the poll of a device. next returns the interval until the
+// following poll from the current one, or a negative one to stop polling
+// the device.
+func (s *pollScheduler) Done(deviceID uint16, next func(interval time.Duration) time.Duration) {
+	s.lock.Lock()
+	if d, ok := s.devices[deviceID]; ok {
+		d.pending = false
+		if d.Interval = next(d.Interval); d.Interval < 0 {
+			delete(s.devices, deviceID)
+		} else {
+			d.next = time.Now().Add(d.Interval)
+		}
+	}
+	s.lock.Unlock()
+	s.notify()
+}
+
+func (s *pollScheduler) notify() {
+	select {
+	case s.wake <- struct{}{}:
+	default:
+	}
+}
+
+func (s *pollScheduler) Run() {
+	timer := time.NewTimer(s.MaxWait)
+	for {
+		select {
+		case <-timer.C:
+		case <-s.wake:
+		}
+
+		now := time.Now()
+		next := now.Add(s.MaxWait)
+		s.lock.Lock()
+		for deviceID, d := range s.devices {
+			if d.pending {
+				continue
+			}
+			if !d.next.After(now) {
+				deviceID, serialNumber := deviceID, d.SerialNumber
+				d.pending = backgroundWorker.Submit(func() { s.poll(deviceID, serialNumber) })
+				if !d.pending {
+					d.next = now.Add(s.Retry)
+				}
+			}
+			if !d.pending && d.next.Before(next) {
+				next = d.next
+			}
+		}
+		s.lock.Unlock()
+
+		if !timer.Stop() {
+			select {
+			case <-timer.C:
+			default:
+			}
+		}
+		timer.Reset(time.Until(next))
+	}
+}
@@ -0,0 +1,373 @@
+package main
+
+/*
+#include "jabra/Common.h"
+#include "jabra/Interface_Video.h"
+*/
+import "C"
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/crc32"
+	"log"
+	"net/http"
+	"os"
+	"sort"
+	"strconv"
+	"sync"
+	"time"
+)
+
+// Camera presets are kept in a single file, rewritten on every change. All
+// integers are little endian:
+//
+//	magic "JBPR", version uint8, count uint32, then per preset:
+//	  name (uint8 length + bytes), presetRecord
+//	crc32 (IEEE) of everything before it
+const (
+	presetsMagic   = "JBPR"
+	presetsVersion = 1
+)
+
+var errPresets = errors.New("invalid presets file")
+
+const (
+	presetHasPTZ = 1 << iota
+	presetHasImageQuality
+)
+
+// presetRecord is the fixed-size encoding of a preset, 32 bytes.
+type presetRecord struct {
+	Flags                                                     uint8
+	Pan, Tilt                                                 int32
+	Zoom                                                      uint16
+	Contrast, Sharpness, Brightness, Saturation, WhiteBalance int32
+	AutoWhiteBalance                                          uint8
+}
+
+// Preset is a named camera position and image, either can be missing when
+// the camera it was stored from does not support it.
+type Preset struct {
+	PTZ          *PTZPosition  `json:",omitempty"`
+	ImageQuality *ImageQuality `json:",omitempty"`
+}
+
+// PresetLibrary holds any number of named presets, unlike the few preset
+// slots of the devices. Recalls go through the PTZ and image-quality caches
+// so only what differs from the camera state is written.
+type PresetLibrary struct {
+	Path    string
+	lock    sync.Mutex
+	presets map[string]Preset
+	// recall latencies of the library and of the device preset slots
+	library presetLatency
+	slots   presetLatency
+}
+
+// presetLatency accumulates the recall latencies of one kind of preset,
+// l.lock must be held.
+type presetLatency struct {
+	Recalls        int64
+	LatencyLast    time.Duration
+	LatencyMax     time.Duration
+	LatencyAverage time.Duration
+	sum            time.Duration
+}
+
+func (p *presetLatency) add(latency time.Duration) {
+	p.Recalls++
+	p.sum += latency
+	p.LatencyLast = latency
+	if latency > p.LatencyMax {
+		p.LatencyMax = latency
+	}
+	p.LatencyAverage = p.sum / time.Duration(p.Recalls)
+}
+
+// presets is nil unless the daemon was started with -presets.
+var presets *PresetLibrary
+
+func LoadPresets(path string) (*PresetLibrary, error) {
+	library := &PresetLibrary{Path: path, presets: make(map[string]Preset)}
+	registerStats("presets", library.stats)
+	data, err := os.ReadFile(path)
+	if os.IsNotExist(err) {
+		return library, nil
+	}
+	if err != nil {
+		return nil, err
+	}
+	if len(data) < len(presetsMagic)+1+4+4 || string(data[:4]) != presetsMagic {
+		return nil, errPresets
+	}
+	body, sum := data[:len(data)-4], binary.LittleEndian.Uint32(data[len(data)-4:])
+	if crc32.ChecksumIEEE(body) != sum || body[4] != presetsVersion {
+		return nil, errPresets
+	}
+	r := bytes.NewReader(body[5:])
+	var count uint32
+	if binary.Read(r, binary.LittleEndian, &count) != nil {
+		return nil, errPresets
+	}
+	for i := uint32(0); i < count; i++ {
+		name, err := readShortString(r)
+		if err != nil {
+			return nil, errPresets
+		}
+		var record presetRecord
+		if binary.Read(r, binary.LittleEndian, &record) != nil {
+			return nil, errPresets
+		}
+		library.presets[name] = record.preset()
+	}
+	return library, nil
+}
+
+func (record *presetRecord) preset() Preset {
+	var preset Preset
+	if record.Flags&presetHasPTZ != 0 {
+		preset.PTZ = &PTZPosition{Pan: record.Pan, Tilt: record.Tilt, Zoom: record.Zoom}
+	}
+	if record.Flags&presetHasImageQuality != 0 {
+		preset.ImageQuality = &ImageQuality{
+			Contrast:         int(record.Contrast),
+			Sharpness:        int(record.Sharpness),
+			Brightness:       int(record.Brightness),
+			Saturation:       int(record.Saturation),
+			WhiteBalance:     int(record.WhiteBalance),
+			AutoWhiteBalance: record.AutoWhiteBalance != 0,
+		}
+	}
+	return preset
+}
+
+func newPresetRecord(preset Preset) presetRecord {
+	var record presetRecord
+	if p := preset.PTZ; p != nil {
+		record.Flags |= presetHasPTZ
+		record.Pan, record.Tilt, record.Zoom = p.Pan, p.Tilt, p.Zoom
+	}
+	if q := preset.ImageQuality; q != nil {
+		record.Flags |= presetHasImageQuality
+		record.Contrast, record.Sharpness, record.Brightness = int32(q.Contrast), int32(q.Sharpness), int32(q.Brightness)
+		record.Saturation, record.WhiteBalance = int32(q.Saturation), int32(q.WhiteBalance)
+		if q.AutoWhiteBalance {
+			record.AutoWhiteBalance = 1
+		}
+	}
+	return record
+}
+
+// save rewrites the presets file, l.lock must be held.
+func (l *PresetLibrary) save() error {
+	names := make([]string, 0, len(l.presets))
+	for name := range l.presets {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+	buf := bytes.Buffer{}
+	buf.WriteString(presetsMagic)
+	buf.WriteByte(presetsVersion)
+	binary.Write(&buf, binary.LittleEndian, uint32(len(names)))
+	for _, name := range names {
+		writeShortString(&buf, name)
+		record := newPresetRecord(l.presets[name])
+		binary.Write(&buf, binary.LittleEndian, &record)
+	}
+	binary.Write(&buf, binary.LittleEndian, crc32.ChecksumIEEE(buf.Bytes()))
+	tmp := l.Path + ".tmp"
+	if err := os.WriteFile(tmp, buf.Bytes(), 0644); err != nil {
+		return err
+	}
+	return os.Rename(tmp, l.Path)
+}
+
+// Store saves the current position and image of a camera under a name.
+func (l *PresetLibrary) Store(name string, device *DeviceInfo) (Preset, error) {
+	if name == "" || len(name) > 255 {
+		return Preset{}, errors.New("preset names are 1 to 255 bytes long")
+	}
+	var preset Preset
+	if camera, err := openPTZ(device); err == nil {
+		position := camera.Target()
+		preset.PTZ = &position
+	}
+	if camera, err := openImageQuality(device); err == nil {
+		values := camera.Values()
+		preset.ImageQuality = &values
+	}
+	if preset.PTZ == nil && preset.ImageQuality == nil {
+		return Preset{}, errors.New(device.DeviceName + " has no camera controls")
+	}
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	l.presets[name] = preset
+	return preset, l.save()
+}
+
+func (l *PresetLibrary) Delete(name string) error {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	if _, ok := l.presets[name]; !ok {
+		return nil
+	}
+	delete(l.presets, name)
+	return l.save()
+}
+
+// PresetRecall is the outcome of a recall: the controls written and how
+// long the writes took, up to the last command accepted by the camera.
+type PresetRecall struct {
+	Written  []string
+	Duration time.Duration
+}
+
+// Recall moves a camera to a preset, writing only what differs from its current state.
+func (l *PresetLibrary) Recall(name string, device *DeviceInfo) (PresetRecall, error) {
+	l.lock.Lock()
+	preset, ok := l.presets[name]
+	l.lock.Unlock()
+	if !ok {
+		return PresetRecall{}, errors.New("no preset " + name)
+	}
+	start := time.Now()
+	result, err := recallPreset(preset, device)
+	result.Duration = time.Since(start)
+	if err == nil {
+		l.lock.Lock()
+		l.library.add(result.Duration)
+		l.lock.Unlock()
+	}
+	return result, err
+}
+
+// RecallSlot applies one of the PTZ preset slots of the camera (1 to 3),
+// timed like Recall so both can be compared in /stats/presets.
+func (l *PresetLibrary) RecallSlot(slot int, device *DeviceInfo) (PresetRecall, error) {
+	if slot < 1 || slot > 3 {
+		return PresetRecall{}, errors.New("preset slots are 1 to 3")
+	}
+	start := time.Now()
+	if ret := C.Jabra_ApplyPTZPreset(C.ushort(device.DeviceID), C.Jabra_PTZPreset(slot-1)); ret != C.Return_Ok {
+		return PresetRecall{}, fmt.Errorf("failed to apply preset slot %d on %s: %d", slot, device.DeviceName, int(ret))
+	}
+	result := PresetRecall{Written: []string{"PTZ"}, Duration: time.Since(start)}
+	// the camera moved behind the back of the PTZ cache
+	removePTZ(device)
+	l.lock.Lock()
+	l.slots.add(result.Duration)
+	l.lock.Unlock()
+	return result, nil
+}
+
+func recallPreset(preset Preset, device *DeviceInfo) (PresetRecall, error) {
+	var result PresetRecall
+	if preset.PTZ != nil {
+		camera, err := openPTZ(device)
+		if err != nil {
+			return result, err
+		}
+		// the position is sent now rather than by the move coalescer, so
+		// errors are reported to the caller
+		camera.Set(*preset.PTZ)
+		written, err := camera.Flush()
+		if written {
+			result.Written = append(result.Written, "PTZ")
+		}
+		if err != nil {
+			return result, err
+		}
+	}
+	if q := preset.ImageQuality; q != nil {
+		written, err := ApplyImageQuality(device, ImageQualityProfile{
+			Contrast:         &q.Contrast,
+			Sharpness:        &q.Sharpness,
+			Brightness:       &q.Brightness,
+			Saturation:       &q.Saturation,
+			WhiteBalance:     &q.WhiteBalance,
+			AutoWhiteBalance: &q.AutoWhiteBalance,
+		})
+		result.Written = append(result.Written, written...)
+		if err != nil {
+			return result, err
+		}
+	}
+	return result, nil
+}
+
+func (l *PresetLibrary) stats() interface{} {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	return struct {
+		Library presetLatency
+		Slots   presetLatency
+	}{l.library, l.slots}
+}
+
+func (l *PresetLibrary) list() map[string]Preset {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	list := make(map[string]Preset, len(l.presets))
+	for name, preset := range l.presets {
+		list[name] = preset
+	}
+	return list
+}
+
+// servePresets lists the presets (GET), stores the camera of ?serial= as
+// ?name= (PUT), recalls it on the camera (POST) or deletes it (DELETE). A
+// POST with ?slot= instead of ?name= applies a preset slot of the camera.
+func servePresets(w http.ResponseWriter, r *http.Request) {
+	if presets == nil {
+		http.Error(w, "no presets file", http.StatusNotFound)
+		return
+	}
+	name := r.URL.Query().Get("name")
+	if r.Method == http.MethodGet {
+		writeJSON(w, presets.list())
+		return
+	}
+	if r.Method == http.MethodDelete {
+		if err := presets.Delete(name); err != nil {
+			http.Error(w, err.Error(), http.StatusInternalServerError)
+		}
+		return
+	}
+	device := findDevice(r.URL.Query().Get("serial"))
+	if device == nil {
+		http.Error(w, "no attached device "+r.URL.Query().Get("serial"), http.StatusNotFound)
+		return
+	}
+	switch r.Method {
+	case http.MethodPut:
+		preset, err := presets.Store(name, device)
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		writeJSON(w, preset)
+	case http.MethodPost:
+		var result PresetRecall
+		var err error
+		if slot := r.URL.Query().Get("slot"); slot != "" {
+			n, _ := strconv.Atoi(slot)
+			result, err = presets.RecallSlot(n, device)
+		} else {
+			result, err = presets.Recall(name, device)
+		}
+		if err != nil {
+			log.Println("presets:", err)
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		writeJSON(w, result)
+	default:
+		http.Error(w, "GET, PUT, POST or DELETE", http.StatusMethodNotAllowed)
+	}
+}
+
+func init() {
+	registerControl("/presets", servePresets)
+}
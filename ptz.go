@@ -0,0 +1,333 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/Interface_Video.h"
+*/
+import "C"
+import (
+	"errors"
+	"fmt"
+	"log"
+	"net/http"
+	"strconv"
+	"sync"
+	"time"
+)
+
+// ptzInterval is the minimum time between two commands sent to a camera,
+// moves requested in between are merged into the next one.
+const ptzInterval = 50 * time.Millisecond
+
+// ptzRefresh is how often the position is read back from an idle camera,
+// which may be moved by its own controls or another application.
+const ptzRefresh = 30 * time.Second
+
+type PTZPosition struct {
+	Pan  int32
+	Tilt int32
+	Zoom uint16
+}
+
+type CameraLimit struct {
+	Min  int32
+	Max  int32
+	Step int32
+}
+
+func (l CameraLimit) clamp(v int64) int64 {
+	if v < int64(l.Min) {
+		return int64(l.Min)
+	}
+	if v > int64(l.Max) {
+		return int64(l.Max)
+	}
+	return v
+}
+
+type PTZLimits struct {
+	Pan  CameraLimit
+	Tilt CameraLimit
+	Zoom CameraLimit
+}
+
+// ptzCamera is the pan/tilt/zoom pipeline of a camera. Moves update the
+// target only, a goroutine per camera sends the latest target as absolute
+// positions at most every ptzInterval, so a burst of moves from a UI drag
+// costs a couple of commands instead of one USB round trip each. The
+// position is read back every ptzRefresh and after a failed command.
+type ptzCamera struct {
+	deviceID uint16
+	limits   PTZLimits  // read once, they are static
+	sendLock sync.Mutex // serializes send
+	lock     sync.Mutex
+	sent     PTZPosition
+	target   PTZPosition
+	wake     chan struct{}
+	stop     chan struct{}
+}
+
+var ptzCameras = make(map[uint16]*ptzCamera, 0)
+var ptzLock = sync.Mutex{}
+
+// openPTZ returns the pipeline of a camera, reading its limits and
+// position the first time.
+func openPTZ(device *DeviceInfo) (*ptzCamera, error) {
+	ptzLock.Lock()
+	camera, ok := ptzCameras[device.DeviceID]
+	ptzLock.Unlock()
+	if ok {
+		return camera, nil
+	}
+
+	id := C.ushort(device.DeviceID)
+	var pan, tilt C.Jabra_PanTiltLimits
+	var zoom C.Jabra_ZoomLimits
+	if ret := C.Jabra_GetPanTiltLimits(id, &pan, &tilt); ret != C.Return_Ok {
+		return nil, fmt.Errorf("failed to read pan/tilt limits of %s: %d", device.DeviceName, int(ret))
+	}
+	if ret := C.Jabra_GetZoomLimits(id, &zoom); ret != C.Return_Ok {
+		return nil, fmt.Errorf("failed to read zoom limits of %s: %d", device.DeviceName, int(ret))
+	}
+	camera = &ptzCamera{
+		deviceID: device.DeviceID,
+		limits: PTZLimits{
+			Pan:  CameraLimit{int32(pan.min), int32(pan.max), int32(pan.stepSize)},
+			Tilt: CameraLimit{int32(tilt.min), int32(tilt.max), int32(tilt.stepSize)},
+			Zoom: CameraLimit{int32(zoom.min), int32(zoom.max), int32(zoom.stepSize)},
+		},
+		wake: make(chan struct{}, 1),
+		stop: make(chan struct{}),
+	}
+	position, err := camera.read()
+	if err != nil {
+		return nil, errors.New("failed to read pan/tilt/zoom of " + device.DeviceName)
+	}
+	camera.sent, camera.target = position, position
+
+	ptzLock.Lock()
+	defer ptzLock.Unlock()
+	if known, ok := ptzCameras[device.DeviceID]; ok {
+		return known, nil
+	}
+	ptzCameras[device.DeviceID] = camera
+	go camera.run()
+	return camera, nil
+}
+
+func removePTZ(device *DeviceInfo) {
+	ptzLock.Lock()
+	defer ptzLock.Unlock()
+	if camera, ok := ptzCameras[device.DeviceID]; ok {
+		close(camera.stop)
+		delete(ptzCameras, device.DeviceID)
+	}
+}
+
+// Move shifts the target by a number of steps on each axis.
+func (camera *ptzCamera) Move(pan, tilt, zoom int) PTZPosition {
+	l := camera.limits
+	return camera.update(func(t PTZPosition) (int64, int64, int64) {
+		return int64(t.Pan) + int64(pan)*int64(l.Pan.Step),
+			int64(t.Tilt) + int64(tilt)*int64(l.Tilt.Step),
+			int64(t.Zoom) + int64(zoom)*int64(l.Zoom.Step)
+	})
+}
+
+// Set replaces the target.
+func (camera *ptzCamera) Set(position PTZPosition) PTZPosition {
+	return camera.update(func(PTZPosition) (int64, int64, int64) {
+		return int64(position.Pan), int64(position.Tilt), int64(position.Zoom)
+	})
+}
+
+// update computes a new target from the current one, clamped to the camera limits.
+func (camera *ptzCamera) update(next func(PTZPosition) (int64, int64, int64)) PTZPosition {
+	l := camera.limits
+	camera.lock.Lock()
+	pan, tilt, zoom := next(camera.target)
+	camera.target = PTZPosition{Pan: int32(l.Pan.clamp(pan)), Tilt: int32(l.Tilt.clamp(tilt)), Zoom: uint16(l.Zoom.clamp(zoom))}
+	target := camera.target
+	camera.lock.Unlock()
+	select {
+	case camera.wake <- struct{}{}:
+	default:
+	}
+	return target
+}
+
+func (camera *ptzCamera) Target() PTZPosition {
+	camera.lock.Lock()
+	defer camera.lock.Unlock()
+	return camera.target
+}
+
+func (camera *ptzCamera) run() {
+	last := time.Time{}
+	refresh := time.NewTicker(ptzRefresh)
+	defer refresh.Stop()
+	for {
+		select {
+		case <-camera.wake:
+		case <-refresh.C:
+			if err := camera.refresh(); err != nil {
+				log.Println("ptz:", err)
+			}
+			continue
+		case <-camera.stop:
+			return
+		}
+		if wait := time.Until(last.Add(ptzInterval)); wait > 0 {
+			select {
+			case <-time.After(wait):
+			case <-camera.stop:
+				return
+			}
+		}
+		last = time.Now()
+		if _, err := camera.send(); err != nil {
+			log.Println("ptz:", err)
+		}
+	}
+}
+
+// Flush sends the target right away instead of waiting for the next
+// command slot, and reports whether anything was written.
+func (camera *ptzCamera) Flush() (bool, error) {
+	return camera.send()
+}
+
+// read returns the current position of the camera.
+func (camera *ptzCamera) read() (PTZPosition, error) {
+	id := C.ushort(camera.deviceID)
+	var pan, tilt C.int32_t
+	var zoom C.uint16_t
+	if ret := C.Jabra_GetPanTilt(id, &pan, &tilt); ret != C.Return_Ok {
+		return PTZPosition{}, fmt.Errorf("failed to read pan/tilt of device %d: %d", camera.deviceID, int(ret))
+	}
+	if ret := C.Jabra_GetZoom(id, &zoom); ret != C.Return_Ok {
+		return PTZPosition{}, fmt.Errorf("failed to read zoom of device %d: %d", camera.deviceID, int(ret))
+	}
+	return PTZPosition{int32(pan), int32(tilt), uint16(zoom)}, nil
+}
+
+// refresh reads the position back from the camera, a target that is not
+// sent yet is kept.
+func (camera *ptzCamera) refresh() error {
+	camera.sendLock.Lock()
+	defer camera.sendLock.Unlock()
+	camera.lock.Lock()
+	sent := camera.sent
+	camera.lock.Unlock()
+	return camera.reread(sent)
+}
+
+// reread reads the position back with sendLock held, the target is replaced
+// by it unless it moved away from stale in the meantime.
+func (camera *ptzCamera) reread(stale PTZPosition) error {
+	position, err := camera.read()
+	if err != nil {
+		return err
+	}
+	camera.lock.Lock()
+	defer camera.lock.Unlock()
+	if camera.target == stale {
+		camera.target = position
+	}
+	camera.sent = position
+	return nil
+}
+
+// send writes the axes of the target that differ from what was last sent.
+func (camera *ptzCamera) send() (bool, error) {
+	camera.sendLock.Lock()
+	defer camera.sendLock.Unlock()
+	camera.lock.Lock()
+	target, sent := camera.target, camera.sent
+	camera.lock.Unlock()
+
+	id := C.ushort(camera.deviceID)
+	written := false
+	var err error
+	if target.Pan != sent.Pan || target.Tilt != sent.Tilt {
+		if ret := C.Jabra_SetPanTilt(id, C.int32_t(target.Pan), C.int32_t(target.Tilt)); ret != C.Return_Ok {
+			err = fmt.Errorf("failed to set pan/tilt on device %d: %d", camera.deviceID, int(ret))
+		} else {
+			sent.Pan, sent.Tilt = target.Pan, target.Tilt
+			written = true
+		}
+	}
+	if target.Zoom != sent.Zoom {
+		if ret := C.Jabra_SetZoom(id, C.uint16_t(target.Zoom)); ret != C.Return_Ok {
+			if err == nil {
+				err = fmt.Errorf("failed to set zoom on device %d: %d", camera.deviceID, int(ret))
+			}
+		} else {
+			sent.Zoom = target.Zoom
+			written = true
+		}
+	}
+	camera.lock.Lock()
+	camera.sent = sent
+	camera.lock.Unlock()
+	if err != nil {
+		// the camera refused the position, the target is where it stayed
+		if rerr := camera.reread(target); rerr != nil {
+			log.Println("ptz:", rerr)
+		}
+	}
+	return written, err
+}
+
+// servePTZ returns the target and limits of the camera given by ?serial=,
+// a POST with pan, tilt and zoom sets the target, or moves it by that
+// many steps with relative=1.
+func servePTZ(w http.ResponseWriter, r *http.Request) {
+	query := r.URL.Query()
+	device := findDevice(query.Get("serial"))
+	if device == nil {
+		http.Error(w, "no attached device "+query.Get("serial"), http.StatusNotFound)
+		return
+	}
+	camera, err := openPTZ(device)
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusNotImplemented)
+		return
+	}
+	if r.Method == http.MethodPost {
+		// values are clamped to the camera limits, never truncated
+		values, given := [3]int64{}, [3]bool{}
+		for i, axis := range []string{"pan", "tilt", "zoom"} {
+			if query.Get(axis) == "" {
+				continue
+			}
+			if values[i], err = strconv.ParseInt(query.Get(axis), 10, 32); err != nil {
+				http.Error(w, err.Error(), http.StatusBadRequest)
+				return
+			}
+			given[i] = true
+		}
+		if query.Get("relative") == "1" {
+			camera.Move(int(values[0]), int(values[1]), int(values[2]))
+		} else {
+			camera.update(func(t PTZPosition) (int64, int64, int64) {
+				target := [3]int64{int64(t.Pan), int64(t.Tilt), int64(t.Zoom)}
+				for i := range target {
+					if given[i] {
+						target[i] = values[i]
+					}
+				}
+				return target[0], target[1], target[2]
+			})
+		}
+	}
+	writeJSON(w, struct {
+		Target PTZPosition
+		Limits PTZLimits
+	}{camera.Target(), camera.limits})
+}
+
+func init() {
+	registerControl("/ptz", servePTZ)
+}
@@ -0,0 +1,92 @@
+package main
+
+import "math"
+
+// timeSample is a sample of a time series, timestamped in unix seconds.
+type timeSample interface {
+	sampleTime() int64
+}
+
+// sampleRing is a fixed-size ring of samples, it never grows once created.
+type sampleRing[S timeSample] struct {
+	samples []S
+	next    int
+	full    bool
+}
+
+func newSampleRing[S timeSample](size int) sampleRing[S] {
+	return sampleRing[S]{samples: make([]S, size)}
+}
+
+func (r *sampleRing[S]) push(s S) {
+	r.samples[r.next] = s
+	r.next = (r.next + 1) % len(r.samples)
+	if r.next == 0 {
+		r.full = true
+	}
+}
+
+// between returns the samples from from to to (excluded), oldest first.
+func (r *sampleRing[S]) between(from, to int64) []S {
+	var out []S
+	n, start := r.next, 0
+	if r.full {
+		n, start = len(r.samples), r.next
+	}
+	for i := 0; i < n; i++ {
+		s := r.samples[(start+i)%len(r.samples)]
+		if t := s.sampleTime(); t >= from && t < to {
+			out = append(out, s)
+		}
+	}
+	return out
+}
+
+// since returns the samples not older than t, oldest first.
+func (r *sampleRing[S]) since(t int64) []S {
+	return r.between(t, math.MaxInt64)
+}
+
+func (r *sampleRing[S]) last() (S, bool) {
+	if !r.full && r.next == 0 {
+		var zero S
+		return zero, false
+	}
+	return r.samples[(r.next+len(r.samples)-1)%len(r.samples)], true
+}
+
+// sampleRollup accumulates the samples of one period of a tier.
+type sampleRollup[S timeSample] interface {
+	add(s S)
+	// result returns the rollup of the count samples added since the last
+	// result, timestamped at the start of the period, and resets it.
+	result(period int64, count int) S
+}
+
+// sampleTier rolls samples up over a fixed period before pushing them to its ring.
+type sampleTier[S timeSample] struct {
+	period int64
+	ring   sampleRing[S]
+	rollup sampleRollup[S]
+	bucket int64
+	count  int
+}
+
+func newSampleTier[S timeSample](period int64, size int, rollup sampleRollup[S]) sampleTier[S] {
+	return sampleTier[S]{period: period, ring: newSampleRing[S](size), rollup: rollup}
+}
+
+func (t *sampleTier[S]) add(s S) {
+	bucket := s.sampleTime() - s.sampleTime()%t.period
+	if t.count > 0 && bucket != t.bucket {
+		t.flush()
+	}
+	t.bucket = bucket
+	t.rollup.add(s)
+	t.count++
+}
+
+func (t *sampleTier[S]) flush() {
+	t.ring.push(t.rollup.result(t.bucket, t.count))
+	t.count = 0
+}
@@ -0,0 +1,603 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "jabra/Common.h"
+#include "jabra/JabraDeviceConfig.h"
+#include "jabra/Interface_Firmware.h"
+extern void goSettingschangedfunc(unsigned short deviceID, DeviceSettings* settings);
+
+// byte settings hold the key of the selected ListKeyValue
+static inline unsigned short settingByteValue(const void* value) { return *(const unsigned short*)value; }
+static inline void* newSettingByteValue(unsigned short key) {
+	unsigned short* value = malloc(sizeof(unsigned short));
+	*value = key;
+	return value;
+}
+*/
+import "C"
+import (
+	"encoding/json"
+	"errors"
+	"fmt"
+	"log"
+	"os"
+	"regexp"
+	"sort"
+	"strconv"
+	"sync"
+	"unsafe"
+)
+
+type SettingDependent struct {
+	GUID   string
+	Enable bool
+}
+
+type SettingOption struct {
+	Key        uint16
+	Value      string
+	Dependents []SettingDependent
+}
+
+type SettingValidation struct {
+	MinLength    int
+	MaxLength    int
+	RegExp       string
+	ErrorMessage string
+}
+
+// Setting is the static description of a device setting, from the manifest.
+// Byte settings select one of Options by key, string settings hold text.
+type Setting struct {
+	GUID             string
+	Name             string
+	String           bool
+	Options          []SettingOption
+	Validation       *SettingValidation
+	Restart          bool
+	Protected        bool
+	Dependent        bool
+	DependentDefault string // value of the setting while a parent disables it
+}
+
+// SettingText holds the display strings of a setting, which lookups never need.
+type SettingText struct {
+	HelpText string
+	Group    string
+}
+
+// SettingsManifest holds the settings of a product at a firmware version,
+// it is shared by every device with the same product and firmware. The
+// GUID index is built once, lookups do not scan the settings, and the
+// position of a setting is also its position in the device values.
+type SettingsManifest struct {
+	ProductID uint16
+	Firmware  string
+	Settings  []Setting
+	Text      []SettingText
+	index     map[string]int
+	rules     []*regexp.Regexp // compiled validation expressions, by position
+	edges     [][]settingEdge
+	order     []int
+	levels    []int
+	depth     int
+}
+
+func newSettingsManifest(key settingsManifestKey, size int) *SettingsManifest {
+	return &SettingsManifest{
+		ProductID: key.ProductID,
+		Firmware:  key.Firmware,
+		Settings:  make([]Setting, 0, size),
+		Text:      make([]SettingText, 0, size),
+		index:     make(map[string]int, size),
+		rules:     make([]*regexp.Regexp, 0, size),
+	}
+}
+
+func (m *SettingsManifest) add(setting Setting, text SettingText) {
+	m.index[setting.GUID] = len(m.Settings)
+	m.Settings = append(m.Settings, setting)
+	m.Text = append(m.Text, text)
+	m.rules = append(m.rules, compileSettingRule(setting.Validation))
+}
+
+func (m *SettingsManifest) lookup(guid string) (int, bool) {
+	i, ok := m.index[guid]
+	return i, ok
+}
+
+func (m *SettingsManifest) find(guid string) *Setting {
+	if i, ok := m.index[guid]; ok {
+		return &m.Settings[i]
+	}
+	return nil
+}
+
+// normalize returns the stored form of a value: the option key for byte
+// settings, which can be given by key or by option text.
+func (s *Setting) normalize(value string) (string, error) {
+	if s.String {
+		return value, nil
+	}
+	for _, option := range s.Options {
+		if option.Value == value || strconv.Itoa(int(option.Key)) == value {
+			return strconv.Itoa(int(option.Key)), nil
+		}
+	}
+	return "", fmt.Errorf("invalid value %q for setting %s", value, s.Name)
+}
+
+type settingsManifestKey struct {
+	ProductID uint16
+	Firmware  string
+}
+
+// deviceSettings caches the current values of an attached device, they are
+// read once and then kept up to date by the settings change listener.
+type deviceSettings struct {
+	device   *DeviceInfo
+	manifest *SettingsManifest
+	values   []string // by manifest position
+	// compliance state, see compliance.go
+	baseline    *manifestBaseline
+	fingerprint uint64
+	compliance  DeviceCompliance
+	// settings passed to Jabra_SetSettingsChangeListener, owned until the device is removed
+	listening *C.DeviceSettings
+}
+
+var settingsManifests = make(map[settingsManifestKey]*SettingsManifest, 0)
+var settingsDevices = make(map[uint16]*deviceSettings, 0)
+var settingsLock = sync.Mutex{}
+
+// settingsDeviceLock is held by the users of a per-device lock, it is only
+// dropped once the last of them is done, so a device removed and attached
+// again meanwhile never gets a second lock.
+type settingsDeviceLock struct {
+	sync.Mutex
+	users int
+}
+
+// settingsWriteLocks serializes the writes to each device, settingsLoadLocks
+// its first settings read.
+var settingsWriteLocks = make(map[uint16]*settingsDeviceLock, 0)
+var settingsLoadLocks = make(map[uint16]*settingsDeviceLock, 0)
+
+func lockSettingsDevice(locks map[uint16]*settingsDeviceLock, deviceID uint16) func() {
+	settingsLock.Lock()
+	lock, ok := locks[deviceID]
+	if !ok {
+		lock = &settingsDeviceLock{}
+		locks[deviceID] = lock
+	}
+	lock.users++
+	settingsLock.Unlock()
+	lock.Lock()
+	return func() {
+		lock.Unlock()
+		settingsLock.Lock()
+		if lock.users--; lock.users == 0 {
+			delete(locks, deviceID)
+		}
+		settingsLock.Unlock()
+	}
+}
+
+func lockSettingsWrite(deviceID uint16) func() {
+	return lockSettingsDevice(settingsWriteLocks, deviceID)
+}
+
+type SettingsResult struct {
+	Written  []string
+	Failed   []string
+	Skipped  []string // GUIDs the device does not have
+	Disabled []string // GUIDs disabled by the value of another setting
+	Rebooted bool
+}
+
+func readSetting(info *C.SettingInfo) (Setting, SettingText, string) {
+	text := SettingText{HelpText: C.GoString(info.helpText), Group: C.GoString(info.groupName)}
+	s := Setting{
+		GUID:      C.GoString(info.guid),
+		Name:      C.GoString(info.name),
+		String:    info.settingDataType == C.settingString,
+		Restart:   (bool)(info.isDeviceRestart),
+		Protected: (bool)(info.isSettingProtected),
+		Dependent: (bool)(info.isDepedentsetting),
+	}
+	for _, kv := range unsafe.Slice(info.listKeyValue, int(info.listSize)) {
+		option := SettingOption{Key: uint16(kv.key), Value: C.GoString(kv.value)}
+		for _, dependent := range unsafe.Slice(kv.dependents, int(kv.dependentcount)) {
+			option.Dependents = append(option.Dependents, SettingDependent{GUID: C.GoString(dependent.GUID), Enable: (bool)(dependent.enableFlag)})
+		}
+		s.Options = append(s.Options, option)
+	}
+	if info.isValidationSupport && info.validationRule != nil {
+		s.Validation = &SettingValidation{
+			MinLength:    int(info.validationRule.minLength),
+			MaxLength:    int(info.validationRule.maxLength),
+			RegExp:       C.GoString(info.validationRule.regExp),
+			ErrorMessage: C.GoString(info.validationRule.errorMessage),
+		}
+	}
+	if s.Dependent && info.dependentDefaultValue != nil {
+		s.DependentDefault = settingValue(s.String, info.dependentDefaultValue)
+	}
+	return s, text, settingValue(s.String, info.currValue)
+}
+
+func settingValue(isString bool, value unsafe.Pointer) string {
+	if value == nil {
+		return ""
+	}
+	if isString {
+		return C.GoString((*C.char)(value))
+	}
+	return strconv.Itoa(int(C.settingByteValue(value)))
+}
+
+// loadDeviceSettings returns the cached settings of a device, reading them
+// from the device on first use. Concurrent first loads of a device read it
+// once. It makes blocking SDK calls.
+func loadDeviceSettings(device *DeviceInfo) (*deviceSettings, error) {
+	settingsLock.Lock()
+	ds, ok := settingsDevices[device.DeviceID]
+	settingsLock.Unlock()
+	if ok {
+		return ds, nil
+	}
+	defer lockSettingsDevice(settingsLoadLocks, device.DeviceID)()
+	settingsLock.Lock()
+	ds, ok = settingsDevices[device.DeviceID]
+	settingsLock.Unlock()
+	if ok {
+		return ds, nil
+	}
+
+	id := C.ushort(device.DeviceID)
+	key := settingsManifestKey{ProductID: device.ProductID, Firmware: readSDKString(func(buf *C.char, count C.int) C.Jabra_ReturnCode {
+		return C.Jabra_GetFirmwareVersion(id, buf, count)
+	})}
+	settings := C.Jabra_GetSettings(id)
+	if settings == nil {
+		return nil, errors.New("failed to read settings of " + device.DeviceName)
+	}
+	if settings.errStatus != C.NoError {
+		err := errors.New(C.GoString(C.Jabra_GetErrorString(settings.errStatus)))
+		C.Jabra_FreeDeviceSettings(settings)
+		return nil, err
+	}
+
+	// manifests are built under settingsLock so devices of the same product
+	// share one, it takes no device I/O
+	infos := unsafe.Slice(settings.settingInfo, int(settings.settingCount))
+	settingsLock.Lock()
+	manifest, known := settingsManifests[key]
+	if !known {
+		manifest = newSettingsManifest(key, len(infos))
+		for i := range infos {
+			setting, text, _ := readSetting(&infos[i])
+			manifest.add(setting, text)
+		}
+		manifest.buildDependencies()
+		settingsManifests[key] = manifest
+	}
+	settingsLock.Unlock()
+	ds = &deviceSettings{device: device, manifest: manifest, values: make([]string, len(manifest.Settings))}
+	for i := range infos {
+		if j, ok := manifest.lookup(C.GoString(infos[i].guid)); ok {
+			ds.values[j] = settingValue(infos[i].settingDataType == C.settingString, infos[i].currValue)
+		}
+	}
+	settingsLock.Lock()
+	ds.baseline = complianceBaseline.forManifest(manifest)
+	settingsLock.Unlock()
+	ds.fingerprint = ds.baseline.fingerprint(ds.values)
+	ds.checkCompliance()
+
+	if C.Jabra_SetSettingsChangeListener(id, (*[0]byte)(C.goSettingschangedfunc), settings) == C.Return_Ok {
+		ds.listening = settings
+	} else {
+		C.Jabra_FreeDeviceSettings(settings)
+	}
+
+	// removeDevice holds deviceListLock while it drops the settings, so a
+	// device still in the list is dropped after the insert
+	deviceListLock.Lock()
+	attached := deviceList[device.DeviceID] == device
+	if attached {
+		settingsLock.Lock()
+		settingsDevices[device.DeviceID] = ds
+		settingsLock.Unlock()
+	}
+	deviceListLock.Unlock()
+	if !attached {
+		if ds.listening != nil {
+			// the ID may already belong to a device attached since, whose
+			// listener was replaced by this one
+			settingsLock.Lock()
+			newer, ok := settingsDevices[device.DeviceID]
+			settingsLock.Unlock()
+			if ok && newer.listening != nil {
+				C.Jabra_SetSettingsChangeListener(id, (*[0]byte)(C.goSettingschangedfunc), newer.listening)
+			} else {
+				C.Jabra_SetSettingsChangeListener(id, nil, nil)
+			}
+			C.Jabra_FreeDeviceSettings(ds.listening)
+		}
+		return nil, errors.New(device.DeviceName + " removed while its settings were read")
+	}
+	return ds, nil
+}
+
+// set updates a cached value and the compliance fingerprint, settingsLock must be held.
+func (ds *deviceSettings) set(i int, value string) {
+	if ds.values[i] == value {
+		return
+	}
+	ds.fingerprint = ds.baseline.update(ds.fingerprint, i, ds.values[i], value)
+	ds.values[i] = value
+}
+
+func removeDeviceSettings(device *DeviceInfo) {
+	settingsLock.Lock()
+	ds, ok := settingsDevices[device.DeviceID]
+	delete(settingsDevices, device.DeviceID)
+	settingsLock.Unlock()
+	if ok && ds.listening != nil {
+		C.Jabra_SetSettingsChangeListener(C.ushort(device.DeviceID), nil, nil)
+		C.Jabra_FreeDeviceSettings(ds.listening)
+	}
+}
+
+//export goSettingschangedfunc
+func goSettingschangedfunc(deviceid uint16, settings *C.DeviceSettings) {
+	if settings == nil {
+		return
+	}
+	defer C.Jabra_FreeDeviceSettings(settings)
+
+	settingsLock.Lock()
+	defer settingsLock.Unlock()
+	ds, ok := settingsDevices[deviceid]
+	if !ok {
+		return
+	}
+	infos := unsafe.Slice(settings.settingInfo, int(settings.settingCount))
+	for i := range infos {
+		if j, ok := ds.manifest.lookup(C.GoString(infos[i].guid)); ok {
+			ds.set(j, settingValue(infos[i].settingDataType == C.settingString, infos[i].currValue))
+		}
+	}
+	ds.checkCompliance()
+}
+
+// SettingValues returns a copy of the cached values of a device, by GUID.
+func SettingValues(device *DeviceInfo) (map[string]string, error) {
+	ds, err := loadDeviceSettings(device)
+	if err != nil {
+		return nil, err
+	}
+	settingsLock.Lock()
+	defer settingsLock.Unlock()
+	values := make(map[string]string, len(ds.values))
+	for i, value := range ds.values {
+		values[ds.manifest.Settings[i].GUID] = value
+	}
+	return values, nil
+}
+
+// SettingValue returns the cached value of a single setting of a device.
+func SettingValue(device *DeviceInfo, guid string) (string, bool, error) {
+	ds, err := loadDeviceSettings(device)
+	if err != nil {
+		return "", false, err
+	}
+	settingsLock.Lock()
+	defer settingsLock.Unlock()
+	i, ok := ds.manifest.lookup(guid)
+	if !ok {
+		return "", false, nil
+	}
+	return ds.values[i], true, nil
+}
+
+// ApplySettings writes the desired values (by GUID) that differ from the
+// cached ones, a device that already matches gets no write at all. GUIDs
+// unknown to the device are skipped, so a profile can cover several products.
+// The values to write are all validated before anything is written. Settings
+// disabled by a parent setting are not written, the others are written in
+// one batch per dependency level, parents first. A reboot invalidates the
+// device ID, so the batches after one that rebooted the device are not
+// written and reported as failed.
+// It makes blocking SDK calls.
+func ApplySettings(device *DeviceInfo, desired map[string]string) (SettingsResult, error) {
+	return applySettings(device, desired, false)
+}
+
+// ApplyRestartSettings is ApplySettings in a single batch, parents first
+// within it, for settings that reboot the device: it reboots at most once.
+func ApplyRestartSettings(device *DeviceInfo, desired map[string]string) (SettingsResult, error) {
+	return applySettings(device, desired, true)
+}
+
+func applySettings(device *DeviceInfo, desired map[string]string, single bool) (SettingsResult, error) {
+	defer lockSettingsWrite(device.DeviceID)()
+	var result SettingsResult
+	ds, err := loadDeviceSettings(device)
+	if err != nil {
+		return result, err
+	}
+
+	settingsLock.Lock()
+	if err := ds.validateProfile(desired); err != nil {
+		settingsLock.Unlock()
+		return result, err
+	}
+	manifest := ds.manifest
+	target := make(map[int]string, len(desired))
+	for guid, value := range desired {
+		i, ok := manifest.lookup(guid)
+		if !ok {
+			result.Skipped = append(result.Skipped, guid)
+			continue
+		}
+		target[i], _ = manifest.Settings[i].normalize(value)
+	}
+	disabled := manifest.disabled(func(i int) string {
+		if value, ok := target[i]; ok {
+			return value
+		}
+		return ds.values[i]
+	})
+	batches := make([][]int, manifest.depth)
+	for i, value := range target {
+		if disabled[i] {
+			result.Disabled = append(result.Disabled, manifest.Settings[i].GUID)
+		} else if ds.values[i] != value {
+			batches[manifest.levels[i]] = append(batches[manifest.levels[i]], i)
+		}
+	}
+	settingsLock.Unlock()
+	for _, batch := range batches {
+		sort.Ints(batch)
+	}
+	if single {
+		var all []int
+		for _, batch := range batches {
+			all = append(all, batch...)
+		}
+		batches = [][]int{all}
+	}
+
+	for b, batch := range batches {
+		if len(batch) == 0 {
+			continue
+		}
+		if result.Rebooted {
+			for _, batch := range batches[b:] {
+				for _, i := range batch {
+					result.Failed = append(result.Failed, manifest.Settings[i].GUID)
+				}
+			}
+			err = fmt.Errorf("%s rebooted before its dependent settings were written", device.DeviceName)
+			break
+		}
+		settings := make([]*Setting, len(batch))
+		values := make([]string, len(batch))
+		for j, i := range batch {
+			settings[j] = &manifest.Settings[i]
+			values[j] = target[i]
+		}
+		var written SettingsResult
+		written, err = writeSettings(device, settings, values)
+		result.Written = append(result.Written, written.Written...)
+		result.Failed = append(result.Failed, written.Failed...)
+		result.Rebooted = result.Rebooted || written.Rebooted
+
+		failed := make(map[string]bool, len(written.Failed))
+		for _, guid := range written.Failed {
+			failed[guid] = true
+		}
+		settingsLock.Lock()
+		for j, i := range batch {
+			if !failed[settings[j].GUID] {
+				ds.set(i, values[j])
+			}
+		}
+		ds.applyDependentDefaults()
+		ds.checkCompliance()
+		settingsLock.Unlock()
+		if err != nil {
+			// dependents of a failed batch are not written
+			break
+		}
+	}
+	if result.Rebooted {
+		panics.Rebooted(device)
+	}
+	return result, err
+}
+
+// writeSettings sends the given settings with Jabra_SetSettings in a
+// DeviceSettings allocated here, and reports the failed GUIDs.
+func writeSettings(device *DeviceInfo, settings []*Setting, values []string) (SettingsResult, error) {
+	var result SettingsResult
+	infos := (*C.SettingInfo)(C.calloc(C.size_t(len(settings)), C.size_t(unsafe.Sizeof(C.SettingInfo{}))))
+	list := unsafe.Slice(infos, len(settings))
+	defer func() {
+		for i := range list {
+			C.free(unsafe.Pointer(list[i].guid))
+			C.free(list[i].currValue)
+		}
+		C.free(unsafe.Pointer(infos))
+	}()
+	for i, setting := range settings {
+		list[i].guid = C.CString(setting.GUID)
+		if setting.String {
+			list[i].settingDataType = C.settingString
+			list[i].currValue = unsafe.Pointer(C.CString(values[i]))
+		} else {
+			key, _ := strconv.Atoi(values[i])
+			list[i].settingDataType = C.settingByte
+			list[i].currValue = C.newSettingByteValue(C.ushort(key))
+		}
+	}
+	cSettings := C.DeviceSettings{settingCount: C.uint(len(settings)), settingInfo: infos, errStatus: C.NoError}
+
+	id := C.ushort(device.DeviceID)
+	ret := C.Jabra_SetSettings(id, &cSettings)
+	result.Rebooted = ret == C.Device_Rebooted
+	if ret == C.Return_Ok || ret == C.Device_Rebooted {
+		for _, setting := range settings {
+			result.Written = append(result.Written, setting.GUID)
+		}
+		return result, nil
+	}
+
+	failedNames := make(map[string]bool)
+	if failed := C.Jabra_GetFailedSettingNames(id); failed != nil {
+		for _, name := range unsafe.Slice(failed.settingNames, int(failed.count)) {
+			failedNames[C.GoString(name)] = true
+		}
+		C.Jabra_FreeFailedSettings(failed)
+	}
+	for _, setting := range settings {
+		// without details from the SDK every setting is considered failed
+		if len(failedNames) == 0 || failedNames[setting.Name] {
+			result.Failed = append(result.Failed, setting.GUID)
+		} else {
+			result.Written = append(result.Written, setting.GUID)
+		}
+	}
+	return result, fmt.Errorf("failed to write %d settings on %s: %d", len(result.Failed), device.DeviceName, int(ret))
+}
+
+// LoadSettingsProfile reads a JSON object of setting values by GUID.
+func LoadSettingsProfile(path string) (map[string]string, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	profile := make(map[string]string)
+	return profile, json.Unmarshal(data, &profile)
+}
+
+// settingsProfile is applied to every attached device when the daemon is started with -settings-profile.
+var settingsProfile map[string]string
+
+func applySettingsProfile(device *DeviceInfo) {
+	if settingsProfile == nil || device.IsDongle {
+		return
+	}
+	backgroundWorker.Submit(func() {
+		result, err := ApplySettings(device, settingsProfile)
+		if err != nil {
+			log.Println("settings:", err)
+		}
+		if len(result.Written) > 0 {
+			log.Printf("settings: applied %d settings on %s", len(result.Written), device.DeviceName)
+		}
+	})
+}
@@ -0,0 +1,113 @@
+package main
+
+import (
+	"log"
+	"strconv"
+)
+
+// settingEdge links a setting to a dependent setting it enables or disables
+// when it holds the option Key.
+type settingEdge struct {
+	key    uint16
+	child  int
+	enable bool
+}
+
+// buildDependencies orders the manifest settings from the dependents of
+// their options: order is a topological order and level the depth of each
+// setting, parents always have a lower level than their dependents.
+func (m *SettingsManifest) buildDependencies() {
+	m.edges = make([][]settingEdge, len(m.Settings))
+	m.levels = make([]int, len(m.Settings))
+	m.order = make([]int, 0, len(m.Settings))
+	parents := make([]int, len(m.Settings))
+	children := make([][]int, len(m.Settings))
+	for i := range m.Settings {
+		linked := make(map[int]bool)
+		for _, option := range m.Settings[i].Options {
+			for _, dependent := range option.Dependents {
+				child, ok := m.lookup(dependent.GUID)
+				if !ok || child == i {
+					continue
+				}
+				m.edges[i] = append(m.edges[i], settingEdge{key: option.Key, child: child, enable: dependent.Enable})
+				if !linked[child] {
+					linked[child] = true
+					children[i] = append(children[i], child)
+					parents[child]++
+				}
+			}
+		}
+	}
+
+	for i := range m.Settings {
+		if parents[i] == 0 {
+			m.order = append(m.order, i)
+		}
+	}
+	for next := 0; next < len(m.order); next++ {
+		i := m.order[next]
+		for _, child := range children[i] {
+			if m.levels[i]+1 > m.levels[child] {
+				m.levels[child] = m.levels[i] + 1
+			}
+			if parents[child]--; parents[child] == 0 {
+				m.order = append(m.order, child)
+			}
+		}
+	}
+	if len(m.order) < len(m.Settings) {
+		// settings in a cycle are written last, after everything else
+		log.Printf("settings: dependency cycle in the manifest of product %d", m.ProductID)
+		last := 0
+		for _, level := range m.levels {
+			if level > last {
+				last = level
+			}
+		}
+		for i := range m.Settings {
+			if parents[i] > 0 {
+				m.order = append(m.order, i)
+				m.levels[i] = last + 1
+			}
+		}
+	}
+	for _, level := range m.levels {
+		if level+1 > m.depth {
+			m.depth = level + 1
+		}
+	}
+}
+
+// disabled returns the settings disabled by the value of a parent, given
+// the value each setting will have. Disabled parents do not affect their
+// dependents.
+func (m *SettingsManifest) disabled(value func(i int) string) map[int]bool {
+	disabled := make(map[int]bool)
+	for _, i := range m.order {
+		if disabled[i] || len(m.edges[i]) == 0 {
+			continue
+		}
+		key, err := strconv.Atoi(value(i))
+		if err != nil {
+			continue
+		}
+		for _, edge := range m.edges[i] {
+			if int(edge.key) == key && !edge.enable {
+				disabled[edge.child] = true
+			}
+		}
+	}
+	return disabled
+}
+
+// applyDependentDefaults sets the cached value of every setting disabled by
+// the value of a parent to its dependent default, the value the device
+// falls back to, settingsLock must be held.
+func (ds *deviceSettings) applyDependentDefaults() {
+	for i := range ds.manifest.disabled(func(i int) string { return ds.values[i] }) {
+		if value := ds.manifest.Settings[i].DependentDefault; value != "" {
+			ds.set(i, value)
+		}
+	}
+}
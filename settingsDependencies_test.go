@@ -0,0 +1,163 @@
+package main
+
+import (
+	"fmt"
+	"strconv"
+	"testing"
+)
+
+// syntheticManifest builds a manifest of n byte settings where setting i
+// disables setting i+1 with option 1 and enables setting i+fanout with
+// option 0, giving long chains and a wide graph.
+func syntheticManifest(n, fanout int) *SettingsManifest {
+	m := newSettingsManifest(settingsManifestKey{ProductID: 1}, n)
+	for i := 0; i < n; i++ {
+		var disables, enables []SettingDependent
+		if i+1 < n {
+			disables = append(disables, SettingDependent{GUID: strconv.Itoa(i + 1)})
+		}
+		if i+fanout < n {
+			enables = append(enables, SettingDependent{GUID: strconv.Itoa(i + fanout), Enable: true})
+		}
+		m.add(Setting{
+			GUID: strconv.Itoa(i),
+			Name: fmt.Sprintf("setting %d", i),
+			Options: []SettingOption{
+				{Key: 0, Value: "off", Dependents: enables},
+				{Key: 1, Value: "on", Dependents: disables},
+			},
+		}, SettingText{})
+	}
+	m.buildDependencies()
+	return m
+}
+
+func checkDependencyOrder(t *testing.T, m *SettingsManifest) {
+	t.Helper()
+	if len(m.order) != len(m.Settings) {
+		t.Fatalf("order has %d settings, want %d", len(m.order), len(m.Settings))
+	}
+	position := make([]int, len(m.Settings))
+	seen := make([]bool, len(m.Settings))
+	for p, i := range m.order {
+		if seen[i] {
+			t.Fatalf("setting %d appears twice in the order", i)
+		}
+		seen[i] = true
+		position[i] = p
+	}
+	for i, edges := range m.edges {
+		for _, edge := range edges {
+			if m.levels[i] >= m.levels[edge.child] {
+				t.Fatalf("parent %d has level %d, not below its dependent %d at level %d", i, m.levels[i], edge.child, m.levels[edge.child])
+			}
+			if position[i] > position[edge.child] {
+				t.Fatalf("parent %d is ordered after its dependent %d", i, edge.child)
+			}
+		}
+	}
+	for _, level := range m.levels {
+		if level >= m.depth {
+			t.Fatalf("level %d out of depth %d", level, m.depth)
+		}
+	}
+}
+
+func TestBuildDependenciesLargeManifest(t *testing.T) {
+	m := syntheticManifest(20000, 7)
+	checkDependencyOrder(t, m)
+	if m.depth != 20000 {
+		t.Fatalf("depth %d, want 20000 for a single chain", m.depth)
+	}
+
+	wide := newSettingsManifest(settingsManifestKey{ProductID: 2}, 5001)
+	var dependents []SettingDependent
+	for i := 1; i <= 5000; i++ {
+		dependents = append(dependents, SettingDependent{GUID: strconv.Itoa(i)})
+	}
+	wide.add(Setting{GUID: "0", Options: []SettingOption{{Key: 1, Dependents: dependents}}}, SettingText{})
+	for i := 1; i <= 5000; i++ {
+		wide.add(Setting{GUID: strconv.Itoa(i)}, SettingText{})
+	}
+	wide.buildDependencies()
+	checkDependencyOrder(t, wide)
+	if wide.depth != 2 {
+		t.Fatalf("depth %d, want 2", wide.depth)
+	}
+}
+
+func TestBuildDependenciesCycle(t *testing.T) {
+	m := newSettingsManifest(settingsManifestKey{ProductID: 3}, 4)
+	m.add(Setting{GUID: "root", Options: []SettingOption{{Key: 1, Dependents: []SettingDependent{{GUID: "a"}}}}}, SettingText{})
+	m.add(Setting{GUID: "a", Options: []SettingOption{{Key: 1, Dependents: []SettingDependent{{GUID: "b"}}}}}, SettingText{})
+	m.add(Setting{GUID: "b", Options: []SettingOption{{Key: 1, Dependents: []SettingDependent{{GUID: "a"}}}}}, SettingText{})
+	m.add(Setting{GUID: "free"}, SettingText{})
+	m.buildDependencies()
+	if len(m.order) != 4 {
+		t.Fatalf("order %v does not hold every setting", m.order)
+	}
+	a, _ := m.lookup("a")
+	b, _ := m.lookup("b")
+	root, _ := m.lookup("root")
+	if m.levels[a] <= m.levels[root] || m.levels[b] <= m.levels[root] || m.levels[a] != m.depth-1 {
+		t.Fatalf("settings in a cycle are not written last: levels %v, depth %d", m.levels, m.depth)
+	}
+}
+
+func TestDisabledSettings(t *testing.T) {
+	m := syntheticManifest(10000, 3)
+	values := make([]string, len(m.Settings))
+	for i := range values {
+		values[i] = "0"
+	}
+	// every setting on disables its successor, but only when it is not itself disabled
+	for i := 0; i < len(values); i += 2 {
+		values[i] = "1"
+	}
+	values[4] = "1"
+	values[5] = "1"
+	disabled := m.disabled(func(i int) string { return values[i] })
+	for i := range values {
+		want := i > 0 && values[i-1] == "1" && !disabled[i-1]
+		if disabled[i] != want {
+			t.Fatalf("setting %d disabled %v, want %v", i, disabled[i], want)
+		}
+	}
+	if !disabled[5] || disabled[6] {
+		t.Fatal("a disabled parent must not disable its dependents")
+	}
+
+	// enabling dependents never disables
+	for i := range values {
+		values[i] = "0"
+	}
+	if disabled := m.disabled(func(i int) string { return values[i] }); len(disabled) != 0 {
+		t.Fatalf("%d settings disabled by enabling options", len(disabled))
+	}
+	// values that are not option keys are ignored
+	if disabled := m.disabled(func(i int) string { return "text" }); len(disabled) != 0 {
+		t.Fatalf("%d settings disabled by string values", len(disabled))
+	}
+}
+
+func TestApplyDependentDefaults(t *testing.T) {
+	m := newSettingsManifest(settingsManifestKey{ProductID: 5}, 3)
+	m.add(Setting{GUID: "mode", Options: []SettingOption{
+		{Key: 0, Dependents: []SettingDependent{{GUID: "level"}, {GUID: "label"}}},
+		{Key: 1},
+	}}, SettingText{})
+	m.add(Setting{GUID: "level", Dependent: true, DependentDefault: "2"}, SettingText{})
+	m.add(Setting{GUID: "label", String: true, Dependent: true}, SettingText{})
+	m.buildDependencies()
+	ds := &deviceSettings{manifest: m, values: []string{"1", "5", "text"}}
+
+	ds.applyDependentDefaults()
+	if ds.values[1] != "5" {
+		t.Fatalf("enabled setting reset to %q", ds.values[1])
+	}
+	ds.set(0, "0")
+	ds.applyDependentDefaults()
+	if ds.values[1] != "2" || ds.values[2] != "text" {
+		t.Fatalf("disabled settings hold %q and %q, want the default 2 and the unchanged text", ds.values[1], ds.values[2])
+	}
+}
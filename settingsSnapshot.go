@@ -0,0 +1,185 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"hash/crc32"
+	"io"
+	"log"
+	"net/http"
+	"sort"
+	"strconv"
+)
+
+// Settings snapshots only keep the values of a device, the manifest is read
+// from the device on restore. All integers are little endian:
+//
+//	magic "JBSS", version uint8, product id uint16, firmware (uint8 length + bytes)
+//	count uint32, then per setting:
+//	  guid (uint8 length + bytes), type uint8 (0 byte, 1 string)
+//	  byte: key uint16, string: uint16 length + bytes
+//	crc32 (IEEE) of everything before it
+const (
+	settingsSnapshotMagic   = "JBSS"
+	settingsSnapshotVersion = 1
+)
+
+var errSettingsSnapshot = errors.New("invalid settings snapshot")
+
+// SaveSettingsSnapshot encodes the cached values of a device.
+func SaveSettingsSnapshot(w io.Writer, device *DeviceInfo) error {
+	ds, err := loadDeviceSettings(device)
+	if err != nil {
+		return err
+	}
+	buf := bytes.Buffer{}
+	buf.WriteString(settingsSnapshotMagic)
+	buf.WriteByte(settingsSnapshotVersion)
+	binary.Write(&buf, binary.LittleEndian, ds.manifest.ProductID)
+	writeShortString(&buf, ds.manifest.Firmware)
+
+	settingsLock.Lock()
+	order := make([]int, len(ds.values))
+	for i := range order {
+		order[i] = i
+	}
+	sort.Slice(order, func(a, b int) bool { return ds.manifest.Settings[order[a]].GUID < ds.manifest.Settings[order[b]].GUID })
+	binary.Write(&buf, binary.LittleEndian, uint32(len(order)))
+	for _, i := range order {
+		setting := &ds.manifest.Settings[i]
+		writeShortString(&buf, setting.GUID)
+		if setting.String {
+			buf.WriteByte(1)
+			binary.Write(&buf, binary.LittleEndian, uint16(len(ds.values[i])))
+			buf.WriteString(ds.values[i])
+		} else {
+			key, _ := strconv.Atoi(ds.values[i])
+			buf.WriteByte(0)
+			binary.Write(&buf, binary.LittleEndian, uint16(key))
+		}
+	}
+	settingsLock.Unlock()
+
+	binary.Write(&buf, binary.LittleEndian, crc32.ChecksumIEEE(buf.Bytes()))
+	_, err = w.Write(buf.Bytes())
+	return err
+}
+
+// ReadSettingsSnapshot decodes a snapshot into setting values by GUID.
+func ReadSettingsSnapshot(data []byte) (productID uint16, firmware string, values map[string]string, err error) {
+	if len(data) < len(settingsSnapshotMagic)+1+4 || string(data[:4]) != settingsSnapshotMagic {
+		return 0, "", nil, errSettingsSnapshot
+	}
+	body, sum := data[:len(data)-4], binary.LittleEndian.Uint32(data[len(data)-4:])
+	if crc32.ChecksumIEEE(body) != sum {
+		return 0, "", nil, errors.New("settings snapshot checksum mismatch")
+	}
+	if body[4] != settingsSnapshotVersion {
+		return 0, "", nil, errors.New("unsupported settings snapshot version")
+	}
+	r := bytes.NewReader(body[5:])
+	var count uint32
+	if binary.Read(r, binary.LittleEndian, &productID) != nil {
+		return 0, "", nil, errSettingsSnapshot
+	}
+	if firmware, err = readShortString(r); err != nil {
+		return 0, "", nil, err
+	}
+	if binary.Read(r, binary.LittleEndian, &count) != nil {
+		return 0, "", nil, errSettingsSnapshot
+	}
+	values = make(map[string]string, count)
+	for i := uint32(0); i < count; i++ {
+		guid, err := readShortString(r)
+		if err != nil {
+			return 0, "", nil, err
+		}
+		kind, err := r.ReadByte()
+		if err != nil {
+			return 0, "", nil, errSettingsSnapshot
+		}
+		var n uint16
+		if binary.Read(r, binary.LittleEndian, &n) != nil {
+			return 0, "", nil, errSettingsSnapshot
+		}
+		if kind == 0 {
+			values[guid] = strconv.Itoa(int(n))
+			continue
+		}
+		value := make([]byte, n)
+		if _, err := io.ReadFull(r, value); err != nil {
+			return 0, "", nil, errSettingsSnapshot
+		}
+		values[guid] = string(value)
+	}
+	return productID, firmware, values, nil
+}
+
+// RestoreSettingsSnapshot writes back the snapshot values that differ from the device.
+func RestoreSettingsSnapshot(device *DeviceInfo, data []byte) (SettingsResult, error) {
+	productID, _, values, err := ReadSettingsSnapshot(data)
+	if err != nil {
+		return SettingsResult{}, err
+	}
+	if productID != device.ProductID {
+		return SettingsResult{}, errors.New("settings snapshot is for another product")
+	}
+	return ApplySettings(device, values)
+}
+
+func writeShortString(buf *bytes.Buffer, s string) {
+	if len(s) > 255 {
+		s = s[:255]
+	}
+	buf.WriteByte(byte(len(s)))
+	buf.WriteString(s)
+}
+
+func readShortString(r *bytes.Reader) (string, error) {
+	n, err := r.ReadByte()
+	if err != nil {
+		return "", errSettingsSnapshot
+	}
+	s := make([]byte, n)
+	if _, err := io.ReadFull(r, s); err != nil {
+		return "", errSettingsSnapshot
+	}
+	return string(s), nil
+}
+
+// serveSettingsSnapshot downloads (GET) or restores (POST) the settings
+// snapshot of the attached device with the ?serial= serial number.
+func serveSettingsSnapshot(w http.ResponseWriter, r *http.Request) {
+	device := findDevice(r.URL.Query().Get("serial"))
+	if device == nil {
+		http.NotFound(w, r)
+		return
+	}
+	switch r.Method {
+	case http.MethodGet:
+		w.Header().Set("Content-Type", "application/octet-stream")
+		if err := SaveSettingsSnapshot(w, device); err != nil {
+			http.Error(w, err.Error(), http.StatusInternalServerError)
+		}
+	case http.MethodPost:
+		data, err := io.ReadAll(io.LimitReader(r.Body, 1<<20))
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		result, err := RestoreSettingsSnapshot(device, data)
+		if err != nil {
+			log.Println("settings:", err)
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		writeJSON(w, result)
+	default:
+		http.Error(w, "GET or POST", http.StatusMethodNotAllowed)
+	}
+}
+
+func init() {
+	registerControl("/settings/snapshot", serveSettingsSnapshot)
+}
@@ -0,0 +1,107 @@
+package main
+
+import (
+	"bytes"
+	"encoding/json"
+	"strconv"
+	"testing"
+)
+
+// cacheTestSettings caches the settings of a fake device, with every other
+// setting on.
+func cacheTestSettings(t testing.TB, deviceID uint16, m *SettingsManifest) *DeviceInfo {
+	t.Helper()
+	device := &DeviceInfo{DeviceID: deviceID, ProductID: m.ProductID, DeviceName: "test"}
+	ds := &deviceSettings{device: device, manifest: m, values: make([]string, len(m.Settings))}
+	for i := range ds.values {
+		ds.values[i] = strconv.Itoa(i % 2)
+	}
+	settingsLock.Lock()
+	settingsDevices[deviceID] = ds
+	settingsLock.Unlock()
+	t.Cleanup(func() {
+		settingsLock.Lock()
+		delete(settingsDevices, deviceID)
+		settingsLock.Unlock()
+	})
+	return device
+}
+
+func TestSettingsSnapshot(t *testing.T) {
+	m := syntheticManifest(100, 3)
+	device := cacheTestSettings(t, 0xfff0, m)
+	buf := bytes.Buffer{}
+	if err := SaveSettingsSnapshot(&buf, device); err != nil {
+		t.Fatal(err)
+	}
+	productID, _, values, err := ReadSettingsSnapshot(buf.Bytes())
+	if err != nil || productID != m.ProductID || len(values) != len(m.Settings) || values["3"] != "1" {
+		t.Fatalf("ReadSettingsSnapshot = %d %d values %v", productID, len(values), err)
+	}
+	data := buf.Bytes()
+	data[len(data)/2] ^= 1
+	if _, _, _, err := ReadSettingsSnapshot(data); err == nil {
+		t.Error("corrupted snapshot accepted")
+	}
+}
+
+// BenchmarkSettingsSnapshot compares JBSS snapshots with a file holding the
+// whole manifest with the values, like the DeviceSettings that
+// Jabra_SaveSettingsToFile was meant to store. Both SDK file functions are
+// no-ops in this SDK, so the JSON encoding of the settings the SDK returns
+// stands in for them. The size of a snapshot is reported as bytes/snapshot.
+func BenchmarkSettingsSnapshot(b *testing.B) {
+	m := syntheticManifest(500, 3)
+	for i := range m.Settings {
+		m.Text[i] = SettingText{HelpText: "Help text of setting " + strconv.Itoa(i), Group: "Group"}
+	}
+	device := cacheTestSettings(b, 0xfff1, m)
+
+	jbss := bytes.Buffer{}
+	SaveSettingsSnapshot(&jbss, device)
+	type savedSetting struct {
+		Setting
+		SettingText
+		Value string
+	}
+	saveManifest := func() []byte {
+		values, _ := SettingValues(device)
+		saved := make([]savedSetting, len(m.Settings))
+		for i := range m.Settings {
+			saved[i] = savedSetting{m.Settings[i], m.Text[i], values[m.Settings[i].GUID]}
+		}
+		data, _ := json.Marshal(saved)
+		return data
+	}
+	manifest := saveManifest()
+
+	b.Run("jbss/save", func(b *testing.B) {
+		b.ReportMetric(float64(jbss.Len()), "bytes/snapshot")
+		buf := bytes.Buffer{}
+		for i := 0; i < b.N; i++ {
+			buf.Reset()
+			SaveSettingsSnapshot(&buf, device)
+		}
+	})
+	b.Run("jbss/read", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			if _, _, _, err := ReadSettingsSnapshot(jbss.Bytes()); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run("manifest/save", func(b *testing.B) {
+		b.ReportMetric(float64(len(manifest)), "bytes/snapshot")
+		for i := 0; i < b.N; i++ {
+			saveManifest()
+		}
+	})
+	b.Run("manifest/read", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			var saved []savedSetting
+			if err := json.Unmarshal(manifest, &saved); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
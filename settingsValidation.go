@@ -0,0 +1,97 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"regexp"
+	"sort"
+	"strings"
+	"sync"
+	"unicode/utf8"
+)
+
+// Validation expressions are compiled once and shared by every manifest
+// using them, a nil entry marks an expression Go cannot compile. They are
+// anchored, a value must match as a whole.
+var settingRegexps = make(map[string]*regexp.Regexp, 0)
+var settingRegexpsLock = sync.Mutex{}
+
+func compileSettingRule(validation *SettingValidation) *regexp.Regexp {
+	if validation == nil || validation.RegExp == "" {
+		return nil
+	}
+	settingRegexpsLock.Lock()
+	defer settingRegexpsLock.Unlock()
+	re, ok := settingRegexps[validation.RegExp]
+	if !ok {
+		var err error
+		if re, err = regexp.Compile("^(?:" + validation.RegExp + ")$"); err != nil {
+			log.Printf("settings: ignoring validation expression %q: %s", validation.RegExp, err)
+		}
+		settingRegexps[validation.RegExp] = re
+	}
+	return re
+}
+
+// validate checks a value against the setting at position i, without device I/O.
+func (m *SettingsManifest) validate(i int, value string) error {
+	setting := &m.Settings[i]
+	if !setting.String {
+		_, err := setting.normalize(value)
+		return err
+	}
+	validation := setting.Validation
+	if validation == nil {
+		return nil
+	}
+	length := utf8.RuneCountInString(value)
+	invalid := length < validation.MinLength || (validation.MaxLength > 0 && length > validation.MaxLength) ||
+		(m.rules[i] != nil && !m.rules[i].MatchString(value))
+	if !invalid {
+		return nil
+	}
+	if validation.ErrorMessage != "" {
+		return fmt.Errorf("invalid value %q for setting %s: %s", value, setting.Name, validation.ErrorMessage)
+	}
+	return fmt.Errorf("invalid value %q for setting %s", value, setting.Name)
+}
+
+// validateProfile checks the values of a profile that would be written and
+// reports all the invalid ones at once. Values the device already holds and
+// settings disabled by a parent are not written, so they are not checked.
+// settingsLock must be held.
+func (ds *deviceSettings) validateProfile(desired map[string]string) error {
+	m := ds.manifest
+	target := make(map[int]string, len(desired))
+	for guid, value := range desired {
+		if i, ok := m.lookup(guid); ok {
+			if normalized, err := m.Settings[i].normalize(value); err == nil {
+				target[i] = normalized
+			}
+		}
+	}
+	disabled := m.disabled(func(i int) string {
+		if value, ok := target[i]; ok {
+			return value
+		}
+		return ds.values[i]
+	})
+	var problems []string
+	for guid, value := range desired {
+		i, ok := m.lookup(guid)
+		if !ok || disabled[i] {
+			continue
+		}
+		if normalized, ok := target[i]; ok && normalized == ds.values[i] {
+			continue
+		}
+		if err := m.validate(i, value); err != nil {
+			problems = append(problems, err.Error())
+		}
+	}
+	if len(problems) == 0 {
+		return nil
+	}
+	sort.Strings(problems)
+	return fmt.Errorf("%d invalid settings: %s", len(problems), strings.Join(problems, "; "))
+}
@@ -0,0 +1,33 @@
+package main
+
+import "testing"
+
+func TestValidateProfile(t *testing.T) {
+	m := newSettingsManifest(settingsManifestKey{ProductID: 4}, 3)
+	m.add(Setting{GUID: "name", Name: "name", String: true, Validation: &SettingValidation{MaxLength: 8, RegExp: "[a-z]+"}}, SettingText{})
+	m.add(Setting{GUID: "mode", Name: "mode", Options: []SettingOption{
+		{Key: 0, Value: "off", Dependents: []SettingDependent{{GUID: "label"}}},
+		{Key: 1, Value: "on"},
+	}}, SettingText{})
+	m.add(Setting{GUID: "label", Name: "label", String: true, Validation: &SettingValidation{RegExp: "[0-9]+"}}, SettingText{})
+	m.buildDependencies()
+	ds := &deviceSettings{manifest: m, values: []string{"BAD NAME", "1", "12"}}
+
+	for _, c := range []struct {
+		profile map[string]string
+		valid   bool
+	}{
+		{map[string]string{"name": "abc"}, true},
+		{map[string]string{"name": "abc1"}, false}, // the expression must match the whole value
+		{map[string]string{"name": "1abc"}, false},
+		{map[string]string{"name": "BAD NAME", "mode": "on"}, true}, // held by the device, not written
+		{map[string]string{"mode": "2"}, false},
+		{map[string]string{"label": "x1"}, false},
+		{map[string]string{"label": "x1", "mode": "off"}, true}, // disabled by mode, not written
+		{map[string]string{"unknown": "anything"}, true},
+	} {
+		if err := ds.validateProfile(c.profile); (err == nil) != c.valid {
+			t.Errorf("validateProfile(%v) = %v, want valid %v", c.profile, err, c.valid)
+		}
+	}
+}
@@ -0,0 +1,40 @@
+package main
+
+import (
+	"strconv"
+	"testing"
+)
+
+// BenchmarkSettingsLookup compares the GUID index of a manifest with the
+// linear scan over its settings it replaced, on manifests of typical
+// headset (50), large (500) and synthetic (5000) sizes.
+func BenchmarkSettingsLookup(b *testing.B) {
+	for _, n := range []int{50, 500, 5000} {
+		m := syntheticManifest(n, 2)
+		guids := make([]string, n)
+		for i := range guids {
+			guids[i] = strconv.Itoa(i)
+		}
+		b.Run("index/"+strconv.Itoa(n), func(b *testing.B) {
+			for i := 0; i < b.N; i++ {
+				if m.find(guids[i%n]) == nil {
+					b.Fatal("setting not found")
+				}
+			}
+		})
+		b.Run("scan/"+strconv.Itoa(n), func(b *testing.B) {
+			for i := 0; i < b.N; i++ {
+				var found *Setting
+				for j := range m.Settings {
+					if m.Settings[j].GUID == guids[i%n] {
+						found = &m.Settings[j]
+						break
+					}
+				}
+				if found == nil {
+					b.Fatal("setting not found")
+				}
+			}
+		})
+	}
+}
@@ -0,0 +1,98 @@
+package main
+
+import (
+	"encoding/json"
+	"log"
+	"net"
+	"net/http"
+	"os"
+	"strings"
+	"sync"
+)
+
+// Stats sections are served as JSON by the stats server, /stats returns all
+// of them and /stats/<name> a single one.
+var statsSections = make(map[string]func() interface{}, 0)
+var statsLock = sync.Mutex{}
+
+var statsMux = http.NewServeMux()
+
+// controlMux serves the endpoints that change devices, it is only served on
+// a unix socket, whose file permissions restrict who can connect. A TCP
+// listener serves statsMux, where these endpoints are read-only.
+var controlMux = http.NewServeMux()
+
+func registerStats(name string, section func() interface{}) {
+	statsLock.Lock()
+	defer statsLock.Unlock()
+	statsSections[name] = section
+}
+
+// registerControl serves an endpoint that changes devices with a method
+// other than GET. On a TCP listener only its GET requests are served.
+func registerControl(pattern string, handler http.HandlerFunc) {
+	controlMux.HandleFunc(pattern, handler)
+	statsMux.HandleFunc(pattern, func(w http.ResponseWriter, r *http.Request) {
+		if r.Method != http.MethodGet && r.Method != http.MethodHead {
+			http.Error(w, r.Method+" is only served on the -stats unix socket", http.StatusForbidden)
+			return
+		}
+		handler(w, r)
+	})
+}
+
+func init() {
+	controlMux.Handle("/", statsMux)
+	statsMux.HandleFunc("/stats", func(w http.ResponseWriter, r *http.Request) {
+		statsLock.Lock()
+		sections := make(map[string]func() interface{}, len(statsSections))
+		for name, section := range statsSections {
+			sections[name] = section
+		}
+		statsLock.Unlock()
+
+		all := make(map[string]interface{}, len(sections))
+		for name, section := range sections {
+			all[name] = section()
+		}
+		writeJSON(w, all)
+	})
+	statsMux.HandleFunc("/stats/", func(w http.ResponseWriter, r *http.Request) {
+		statsLock.Lock()
+		section, ok := statsSections[strings.TrimPrefix(r.URL.Path, "/stats/")]
+		statsLock.Unlock()
+		if !ok {
+			http.NotFound(w, r)
+			return
+		}
+		writeJSON(w, section())
+	})
+}
+
+func writeJSON(w http.ResponseWriter, v interface{}) {
+	w.Header().Set("Content-Type", "application/json")
+	encoder := json.NewEncoder(w)
+	encoder.SetIndent("", "  ")
+	if err := encoder.Encode(v); err != nil {
+		log.Println("stats:", err)
+	}
+}
+
+// serveStats listens on a TCP address, or on a unix socket when addr is a
+// path. Only the unix socket serves the endpoints that change devices.
+func serveStats(addr string) {
+	network, mux := "tcp", statsMux
+	if strings.HasPrefix(addr, "/") {
+		network, mux = "unix", controlMux
+		os.Remove(addr)
+	}
+	listener, err := net.Listen(network, addr)
+	if err != nil {
+		log.Println("stats:", err)
+		return
+	}
+	log.Println("stats listening on", addr)
+	if err := http.Serve(listener, mux); err != nil {
+		log.Println("stats:", err)
+	}
+}
@@ -0,0 +1,371 @@
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/fnv"
+	"io"
+	"log"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+type TelemetryKind uint16
+
+const (
+	TelemetryBattery TelemetryKind = iota + 1
+	TelemetryBusylight
+	TelemetryDectDensity
+	TelemetryDectHandovers
+	TelemetryLinkQuality
+)
+
+var telemetryKindNames = map[TelemetryKind]string{
+	TelemetryBattery:       "battery",
+	TelemetryBusylight:     "busylight",
+	TelemetryDectDensity:   "dect-density",
+	TelemetryDectHandovers: "dect-handovers",
+	TelemetryLinkQuality:   "link-quality",
+}
+
+func (k TelemetryKind) String() string {
+	if name, ok := telemetryKindNames[k]; ok {
+		return name
+	}
+	return fmt.Sprintf("kind-%d", uint16(k))
+}
+
+// Telemetry segments are memory-mapped files with a 64 bytes header followed
+// by one column per field, each sized for the segment capacity:
+//
+//	header  magic "JBTL", version uint32, capacity uint32, count uint64 at 16
+//	times   int64 unix milliseconds
+//	values  int64
+//	devices uint32 fnv32a hash of the device serial number
+//	kinds   uint16
+//
+// The count is stored after the record, so readers never see a partial one.
+// Segments are flushed with msync on rotation and close, never per sample.
+const (
+	telemetryMagic      = "JBTL"
+	telemetryVersion    = 1
+	telemetryHeaderSize = 64
+	telemetryRecordSize = 8 + 8 + 4 + 2
+	telemetryCapacity   = 1 << 16
+	telemetrySegmentAge = 24 * time.Hour
+)
+
+type telemetrySegment struct {
+	file     *os.File
+	data     []byte
+	capacity int
+	start    time.Time
+}
+
+func (s *telemetrySegment) count() int {
+	return int(atomic.LoadUint64((*uint64)(unsafe.Pointer(&s.data[16]))))
+}
+
+func (s *telemetrySegment) setCount(n int) {
+	atomic.StoreUint64((*uint64)(unsafe.Pointer(&s.data[16])), uint64(n))
+}
+
+func (s *telemetrySegment) times() int   { return telemetryHeaderSize }
+func (s *telemetrySegment) values() int  { return s.times() + 8*s.capacity }
+func (s *telemetrySegment) devices() int { return s.values() + 8*s.capacity }
+func (s *telemetrySegment) kinds() int   { return s.devices() + 4*s.capacity }
+func (s *telemetrySegment) time(i int) int64 {
+	return int64(binary.LittleEndian.Uint64(s.data[s.times()+8*i:]))
+}
+
+func (s *telemetrySegment) record(i int) TelemetryRecord {
+	return TelemetryRecord{
+		Time:   s.time(i),
+		Value:  int64(binary.LittleEndian.Uint64(s.data[s.values()+8*i:])),
+		Device: binary.LittleEndian.Uint32(s.data[s.devices()+4*i:]),
+		Kind:   TelemetryKind(binary.LittleEndian.Uint16(s.data[s.kinds()+2*i:])),
+	}
+}
+
+func (s *telemetrySegment) append(r TelemetryRecord) {
+	i := s.count()
+	binary.LittleEndian.PutUint64(s.data[s.times()+8*i:], uint64(r.Time))
+	binary.LittleEndian.PutUint64(s.data[s.values()+8*i:], uint64(r.Value))
+	binary.LittleEndian.PutUint32(s.data[s.devices()+4*i:], r.Device)
+	binary.LittleEndian.PutUint16(s.data[s.kinds()+2*i:], uint16(r.Kind))
+	s.setCount(i + 1)
+}
+
+func (s *telemetrySegment) close() error {
+	if s.data != nil {
+		if _, _, errno := syscall.Syscall(syscall.SYS_MSYNC, uintptr(unsafe.Pointer(&s.data[0])), uintptr(len(s.data)), syscall.MS_SYNC); errno != 0 {
+			log.Println("telemetry: msync:", errno)
+		}
+		syscall.Munmap(s.data)
+		s.data = nil
+	}
+	return s.file.Close()
+}
+
+func createTelemetrySegment(path string, capacity int) (*telemetrySegment, error) {
+	file, err := os.OpenFile(path, os.O_RDWR|os.O_CREATE|os.O_EXCL, 0644)
+	if err != nil {
+		return nil, err
+	}
+	size := telemetryHeaderSize + telemetryRecordSize*capacity
+	if err := file.Truncate(int64(size)); err != nil {
+		file.Close()
+		return nil, err
+	}
+	data, err := syscall.Mmap(int(file.Fd()), 0, size, syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	if err != nil {
+		file.Close()
+		return nil, err
+	}
+	copy(data, telemetryMagic)
+	binary.LittleEndian.PutUint32(data[4:], telemetryVersion)
+	binary.LittleEndian.PutUint32(data[8:], uint32(capacity))
+	return &telemetrySegment{file: file, data: data, capacity: capacity, start: time.Now()}, nil
+}
+
+func openTelemetrySegment(path string) (*telemetrySegment, error) {
+	file, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	info, err := file.Stat()
+	if err != nil {
+		file.Close()
+		return nil, err
+	}
+	if info.Size() < telemetryHeaderSize {
+		file.Close()
+		return nil, errors.New("telemetry: truncated segment " + path)
+	}
+	data, err := syscall.Mmap(int(file.Fd()), 0, int(info.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		file.Close()
+		return nil, err
+	}
+	segment := &telemetrySegment{file: file, data: data, capacity: int(binary.LittleEndian.Uint32(data[8:]))}
+	if string(data[:4]) != telemetryMagic || binary.LittleEndian.Uint32(data[4:]) != telemetryVersion ||
+		int(info.Size()) < telemetryHeaderSize+telemetryRecordSize*segment.capacity {
+		syscall.Munmap(data)
+		segment.data = nil
+		segment.close()
+		return nil, errors.New("telemetry: invalid segment " + path)
+	}
+	return segment, nil
+}
+
+type TelemetryRecord struct {
+	Time   int64
+	Value  int64
+	Device uint32
+	Kind   TelemetryKind
+}
+
+// TelemetryStore appends telemetry records to rotating segment files in Dir
+// and removes segments older than Retention.
+type TelemetryStore struct {
+	Dir       string
+	Retention time.Duration
+	lock      sync.Mutex
+	segment   *telemetrySegment
+	devices   map[uint32]bool
+}
+
+// telemetry is nil unless the daemon was started with -telemetry.
+var telemetry *TelemetryStore
+
+func NewTelemetryStore(dir string, retention time.Duration) (*TelemetryStore, error) {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return nil, err
+	}
+	store := &TelemetryStore{Dir: dir, Retention: retention, devices: make(map[uint32]bool)}
+	for hash := range readTelemetryDevices(dir) {
+		store.devices[hash] = true
+	}
+	return store, nil
+}
+
+func telemetryDeviceHash(serialNumber string) uint32 {
+	h := fnv.New32a()
+	h.Write([]byte(serialNumber))
+	return h.Sum32()
+}
+
+// Append records a sample, it is a no-op on a nil store.
+func (t *TelemetryStore) Append(serialNumber string, kind TelemetryKind, value int64) {
+	if t == nil {
+		return
+	}
+	t.lock.Lock()
+	defer t.lock.Unlock()
+
+	now := time.Now()
+	if t.segment == nil || t.segment.count() == t.segment.capacity || now.Sub(t.segment.start) > telemetrySegmentAge {
+		if err := t.rotate(now); err != nil {
+			log.Println("telemetry:", err)
+			return
+		}
+	}
+	device := telemetryDeviceHash(serialNumber)
+	if !t.devices[device] {
+		t.devices[device] = true
+		t.writeDevice(device, serialNumber)
+	}
+	t.segment.append(TelemetryRecord{Time: now.UnixMilli(), Value: value, Device: device, Kind: kind})
+}
+
+// rotate closes the current segment, starts a new one and applies the retention, t.lock must be held.
+func (t *TelemetryStore) rotate(now time.Time) error {
+	if t.segment != nil {
+		t.segment.close()
+		t.segment = nil
+	}
+	path := filepath.Join(t.Dir, fmt.Sprintf("%016x.seg", now.UnixNano()))
+	segment, err := createTelemetrySegment(path, telemetryCapacity)
+	if err != nil {
+		return err
+	}
+	t.segment = segment
+
+	if t.Retention > 0 {
+		for _, old := range telemetrySegments(t.Dir) {
+			info, err := os.Stat(old)
+			if err == nil && old != path && now.Sub(info.ModTime()) > t.Retention {
+				os.Remove(old)
+			}
+		}
+	}
+	return nil
+}
+
+func (t *TelemetryStore) writeDevice(device uint32, serialNumber string) {
+	file, err := os.OpenFile(filepath.Join(t.Dir, "devices"), os.O_WRONLY|os.O_APPEND|os.O_CREATE, 0644)
+	if err != nil {
+		log.Println("telemetry:", err)
+		return
+	}
+	defer file.Close()
+	fmt.Fprintf(file, "%08x %s\n", device, serialNumber)
+}
+
+func (t *TelemetryStore) Close() error {
+	if t == nil {
+		return nil
+	}
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	if t.segment == nil {
+		return nil
+	}
+	err := t.segment.close()
+	t.segment = nil
+	return err
+}
+
+func telemetrySegments(dir string) []string {
+	segments, _ := filepath.Glob(filepath.Join(dir, "*.seg"))
+	sort.Strings(segments)
+	return segments
+}
+
+func readTelemetryDevices(dir string) map[uint32]string {
+	devices := make(map[uint32]string)
+	file, err := os.Open(filepath.Join(dir, "devices"))
+	if err != nil {
+		return devices
+	}
+	defer file.Close()
+	scanner := bufio.NewScanner(file)
+	for scanner.Scan() {
+		var hash uint32
+		var serialNumber string
+		if n, _ := fmt.Sscanf(scanner.Text(), "%08x %s", &hash, &serialNumber); n == 2 {
+			devices[hash] = serialNumber
+		}
+	}
+	return devices
+}
+
+// DumpTelemetry streams the records in [from, to) as tab separated lines.
+// Segments are mapped one at a time and only the pages in range are touched.
+func DumpTelemetry(w io.Writer, dir string, from, to time.Time, serialNumber string) error {
+	devices := readTelemetryDevices(dir)
+	out := bufio.NewWriter(w)
+	defer out.Flush()
+
+	segments := telemetrySegments(dir)
+	for i, path := range segments {
+		// segment names are their start time, skip the ones that end before from
+		if i+1 < len(segments) {
+			var next int64
+			fmt.Sscanf(filepath.Base(segments[i+1]), "%x", &next)
+			if next < from.UnixNano() {
+				continue
+			}
+		}
+		var start int64
+		fmt.Sscanf(filepath.Base(path), "%x", &start)
+		if !to.IsZero() && start >= to.UnixNano() {
+			break
+		}
+		if err := dumpTelemetrySegment(out, path, from, to, serialNumber, devices); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+func dumpTelemetrySegment(out *bufio.Writer, path string, from, to time.Time, serialNumber string, devices map[uint32]string) error {
+	segment, err := openTelemetrySegment(path)
+	if err != nil {
+		return err
+	}
+	defer segment.close()
+
+	count := segment.count()
+	first := sort.Search(count, func(i int) bool { return segment.time(i) >= from.UnixMilli() })
+	for i := first; i < count; i++ {
+		r := segment.record(i)
+		if !to.IsZero() && r.Time >= to.UnixMilli() {
+			break
+		}
+		device, ok := devices[r.Device]
+		if !ok {
+			device = fmt.Sprintf("%08x", r.Device)
+		}
+		if serialNumber != "" && device != serialNumber {
+			continue
+		}
+		fmt.Fprintf(out, "%s\t%s\t%s\t%d\n",
+			time.UnixMilli(r.Time).Format(time.RFC3339Nano), device, r.Kind, r.Value)
+	}
+	return nil
+}
+
+// parseTelemetryTime accepts RFC 3339 times or durations relative to now, like -1h.
+func parseTelemetryTime(value string) (time.Time, error) {
+	if value == "" {
+		return time.Time{}, nil
+	}
+	if strings.HasPrefix(value, "-") {
+		d, err := time.ParseDuration(value)
+		if err != nil {
+			return time.Time{}, err
+		}
+		return time.Now().Add(d), nil
+	}
+	return time.Parse(time.RFC3339, value)
+}
@@ -0,0 +1,89 @@
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"io"
+	"path/filepath"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestTelemetryAppendDump(t *testing.T) {
+	dir := t.TempDir()
+	store, err := NewTelemetryStore(dir, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	store.Append("A", TelemetryBattery, 80)
+	store.Append("B", TelemetryLinkQuality, 2)
+	store.Close()
+
+	out := bytes.Buffer{}
+	if err := DumpTelemetry(&out, dir, time.Time{}, time.Time{}, "B"); err != nil {
+		t.Fatal(err)
+	}
+	if lines := strings.Split(strings.TrimSpace(out.String()), "\n"); len(lines) != 1 || !strings.HasSuffix(lines[0], "\tB\tlink-quality\t2") {
+		t.Errorf("dump of B = %q", out.String())
+	}
+}
+
+func BenchmarkTelemetryAppend(b *testing.B) {
+	store, err := NewTelemetryStore(b.TempDir(), 0)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer store.Close()
+	serialNumbers := []string{"A", "B", "C", "D"}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		store.Append(serialNumbers[i%len(serialNumbers)], TelemetryBattery, int64(i%100))
+	}
+}
+
+// writeBenchmarkSegments writes segments full of records one second apart,
+// starting at start.
+func writeBenchmarkSegments(b *testing.B, dir string, segments int, start time.Time) {
+	b.Helper()
+	for s := 0; s < segments; s++ {
+		first := start.Add(time.Duration(s*telemetryCapacity) * time.Second)
+		segment, err := createTelemetrySegment(filepath.Join(dir, fmt.Sprintf("%016x.seg", first.UnixNano())), telemetryCapacity)
+		if err != nil {
+			b.Fatal(err)
+		}
+		for i := 0; i < telemetryCapacity; i++ {
+			segment.append(TelemetryRecord{
+				Time:   first.Add(time.Duration(i) * time.Second).UnixMilli(),
+				Value:  int64(i % 100),
+				Device: uint32(i % 4),
+				Kind:   TelemetryKind(i%5 + 1),
+			})
+		}
+		segment.close()
+	}
+}
+
+// BenchmarkTelemetryScan dumps 4 segments (262144 records) in full and the
+// last hour of them, which only maps the last segment and binary searches it.
+func BenchmarkTelemetryScan(b *testing.B) {
+	dir := b.TempDir()
+	start := time.Date(2026, 1, 1, 0, 0, 0, 0, time.UTC)
+	writeBenchmarkSegments(b, dir, 4, start)
+	end := start.Add(4 * telemetryCapacity * time.Second)
+	for _, c := range []struct {
+		name string
+		from time.Time
+	}{
+		{"all", time.Time{}},
+		{"last-hour", end.Add(-time.Hour)},
+	} {
+		b.Run(c.name, func(b *testing.B) {
+			for i := 0; i < b.N; i++ {
+				if err := DumpTelemetry(io.Discard, dir, c.from, time.Time{}, ""); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
@@ -0,0 +1,105 @@
+package main
+
+import (
+	"log"
+	"sync"
+	"time"
+)
+
+// deviceWorker runs background SDK calls (panic collection, inventory...)
+// one at a time from a bounded queue, so they never pile up on the HID
+// transport while the busy light is being updated.
+type deviceWorker struct {
+	jobs     chan func()
+	lock     sync.Mutex
+	overflow []func() // SubmitRetry jobs waiting for room in the queue, in order
+}
+
+var backgroundWorker = newDeviceWorker(64)
+
+func newDeviceWorker(size int) *deviceWorker {
+	w := &deviceWorker{jobs: make(chan func(), size)}
+	go w.run()
+	return w
+}
+
+func (w *deviceWorker) run() {
+	for job := range w.jobs {
+		job()
+	}
+}
+
+// Submit queues a job and returns false if the queue is full.
+func (w *deviceWorker) Submit(job func()) bool {
+	select {
+	case w.jobs <- job:
+		return true
+	default:
+		log.Println("device worker queue full, dropping job")
+		return false
+	}
+}
+
+// SubmitRetry queues a job that must not be dropped, such as the one
+// filling a cache that is otherwise only updated by SDK callbacks. While the
+// queue is full, jobs wait in order in an overflow list that a single
+// goroutine moves to the queue, backing off up to 5s.
+func (w *deviceWorker) SubmitRetry(job func()) {
+	w.lock.Lock()
+	defer w.lock.Unlock()
+	if len(w.overflow) == 0 {
+		select {
+		case w.jobs <- job:
+			return
+		default:
+		}
+	}
+	w.overflow = append(w.overflow, job)
+	if len(w.overflow) == 1 {
+		go w.drainOverflow()
+	}
+}
+
+func (w *deviceWorker) drainOverflow() {
+	delay := 100 * time.Millisecond
+	for {
+		w.lock.Lock()
+		queued := 0
+	fill:
+		for len(w.overflow) > 0 {
+			select {
+			case w.jobs <- w.overflow[0]:
+				w.overflow[0] = nil
+				w.overflow = w.overflow[1:]
+				queued++
+			default:
+				break fill
+			}
+		}
+		left := len(w.overflow)
+		w.lock.Unlock()
+		if left == 0 {
+			return
+		}
+		if queued > 0 {
+			delay = 100 * time.Millisecond
+		}
+		time.Sleep(delay)
+		if delay *= 2; delay > 5*time.Second {
+			delay = 5 * time.Second
+		}
+	}
+}
+
+// Do runs a job on the worker and waits for it to complete.
+func (w *deviceWorker) Do(job func()) bool {
+	done := make(chan struct{})
+	if !w.Submit(func() {
+		defer close(done)
+		job()
+	}) {
+		return false
+	}
+	<-done
+	return true
+}